@@ -18,6 +18,9 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #pragma once
 
 #include "foundation.hpp"
+#include "profile.hpp"
+#include <map>
+#include <string>
 #include <vector>
 
 class Writer;
@@ -25,6 +28,12 @@ namespace writer {
 	class Type;
 	class Value;
 }
+namespace vm {
+	class Compiler;
+}
+class Cache;
+class Interface;
+class EscapeAnalysis;
 
 namespace ast {
 
@@ -32,6 +41,8 @@ class Void;
 class Bool;
 class Int;
 class Class;
+class ArrayType;
+class VectorType;
 
 class Type {
 public:
@@ -39,6 +50,8 @@ public:
 	Type (): type(nullptr) {}
 	virtual Substring get_name () const = 0;
 	virtual const Class* get_class () const { return nullptr; }
+	virtual const ArrayType* get_array () const { return nullptr; }
+	virtual const VectorType* get_vector () const { return nullptr; }
 	static const Void VOID;
 	static const Bool BOOL;
 	static const Int INT;
@@ -59,13 +72,111 @@ public:
 	Substring get_name () const override { return "Int"; }
 };
 
-class Expression {
+// arrays are references to their length followed by the elements
+class ArrayType: public Type {
+	const Type* element_type;
+	std::string name;
+	ArrayType (const Type* element_type);
+public:
+	// there is one array type per element type
+	static const ArrayType* get (const Type* element_type);
+	Substring get_name () const override {
+		return Substring (name.c_str(), name.size());
+	}
+	const Type* get_element_type () const {
+		return element_type;
+	}
+	const ArrayType* get_array () const override {
+		return this;
+	}
+	// arrays of soa classes store every attribute of the elements in its own column
+	bool has_columns () const;
+};
+
+// vectors of Int or Bool lanes that are operated on at once, like Int4
+class VectorType: public Type {
+	const Type* element_type;
+	int lanes;
+	std::string name;
+	VectorType (const Type* element_type, int lanes);
+public:
+	static const VectorType* get (const Type* element_type, int lanes);
+	// the vector type with the given name or null
+	static const VectorType* get (const Substring& name);
+	Substring get_name () const override {
+		return Substring (name.c_str(), name.size());
+	}
+	const Type* get_element_type () const {
+		return element_type;
+	}
+	int get_lanes () const {
+		return lanes;
+	}
+	const VectorType* get_vector () const override {
+		return this;
+	}
+	// the Bool vector with the same number of lanes, which comparisons return
+	const VectorType* get_mask () const {
+		return get (&Type::BOOL, lanes);
+	}
+};
+
+class Pool;
+
+// the objects of a syntax tree, which belong to the pool that was active when they were created
+class Pooled {
+public:
+	Pooled ();
+	Pooled (const Pooled&): Pooled() {}
+	virtual ~Pooled () {}
+};
+
+// Syntax trees are usually kept until the compiler exits. The nodes that are created
+// on a thread while a pool is active are deleted together with the pool instead, so
+// that editors can free the trees that they parse again.
+class Pool {
+	std::vector<Pooled*> objects;
+	static thread_local Pool* current;
+	friend class Pooled;
+public:
+	Pool () {}
+	Pool (const Pool&) = delete;
+	~Pool ();
+	// makes the pool, or no pool, active until the end of the scope
+	class Scope {
+		Pool* previous;
+	public:
+		Scope (Pool* pool): previous(current) {
+			current = pool;
+		}
+		~Scope () {
+			current = previous;
+		}
+	};
+};
+
+inline Pooled::Pooled () {
+	if (Pool::current) Pool::current->objects.push_back (this);
+}
+
+class Expression: public Pooled {
 public:
+	Expression () {
+		profile::count_node ();
+	}
 	virtual writer::Value* insert (Writer&) = 0;
 	virtual bool has_address () { return false; }
 	virtual writer::Value* insert_address (Writer&) { return nullptr; }
 	virtual const Type* get_type () = 0;
 	virtual bool validate () { return true; }
+	virtual int compile (vm::Compiler&) = 0;
+	virtual void compile_store (vm::Compiler&, int) {}
+	// the set of the objects a value of a class type can reference, see EscapeAnalysis
+	virtual int analyze (EscapeAnalysis&) { return -1; }
+	// literals can be stored in interfaces
+	virtual bool get_constant_value (int& value) { return false; }
+	// the array whose length the expression is, for the bounds of loops
+	virtual Expression* get_length_of () { return nullptr; }
 };
 
 class FunctionPrototype {
@@ -98,6 +209,11 @@ class Number: public Expression {
 public:
 	Number (int n): n(n) {}
 	writer::Value* insert (Writer& w) override;
+	bool get_constant_value (int& value) override {
+		value = n;
+		return true;
+	}
+	int compile (vm::Compiler& compiler) override;
 	const Type* get_type () override {
 		return &Type::INT;
 	}
@@ -108,6 +224,11 @@ class BooleanLiteral: public Expression {
 public:
 	BooleanLiteral (bool value): value(value) {}
 	writer::Value* insert (Writer& writer) override;
+	bool get_constant_value (int& value) override {
+		value = this->value;
+		return true;
+	}
+	int compile (vm::Compiler& compiler) override;
 	const Type* get_type () override {
 		return &Type::BOOL;
 	}
@@ -119,15 +240,21 @@ class Variable: public Expression {
 	int n;
 public:
 	writer::Value* value;
-	Variable (const Substring& name, const Type* type): name(name), type(type) {}
+	int line;
+	// like the variables of for loops
+	bool read_only;
+	Variable (const Substring& name, const Type* type, int line = 0): name(name), type(type), line(line), read_only(false) {}
 	const Substring& get_name () const {
 		return name;
 	}
 	void set_n (int n) { this->n = n; }
 	int get_n () const { return n; }
 	writer::Value* insert (Writer& writer) override;
-	bool has_address () override { return true; }
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	bool has_address () override { return !read_only; }
 	writer::Value* insert_address (Writer& writer);
+	void compile_store (vm::Compiler& compiler, int source) override;
 	const Type* get_type () override {
 		return type;
 	}
@@ -139,6 +266,8 @@ class Assignment: public Expression {
 public:
 	Assignment (Expression* left, Expression* right): left(left), right(right) {}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
 		return right->get_type ();
 	}
@@ -151,17 +280,24 @@ public:
 };
 
 class BinaryExpression: public Expression {
+protected:
 	const char* instruction;
 	Expression* left;
 	Expression* right;
 public:
 	BinaryExpression (const char* instruction, Expression* left, Expression* right): instruction(instruction), left(left), right(right) {}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
 		return left->get_type ();
 	}
+	// vectors of Int are operated on lane by lane
 	bool validate () override {
-		return left->get_type() == &Type::INT && right->get_type() == &Type::INT;
+		const Type* type = left->get_type ();
+		if (type != right->get_type()) return false;
+		if (const VectorType* vector_type = type->get_vector()) type = vector_type->get_element_type ();
+		return type == &Type::INT;
 	}
 	static Expression* add (Expression* left, Expression* right) {
 		return new BinaryExpression ("add", left, right);
@@ -184,6 +320,7 @@ class ComparisonExpression: public BinaryExpression {
 public:
 	ComparisonExpression (const char* instruction, Expression* left, Expression* right): BinaryExpression(instruction, left, right) {}
 	const Type* get_type () override {
+		if (const VectorType* type = left->get_type()->get_vector()) return type->get_mask ();
 		return &Type::BOOL;
 	}
 	static Expression* eq (Expression* left, Expression* right) {
@@ -212,11 +349,17 @@ class And: public Expression {
 public:
 	And (Expression* left, Expression* right): left(left), right(right) {}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
-		return &Type::BOOL;
+		return left->get_type ();
 	}
+	// vectors of Bool are combined lane by lane, both sides are evaluated
 	bool validate () override {
-		return left->get_type() == &Type::BOOL && right->get_type() == &Type::BOOL;
+		const Type* type = left->get_type ();
+		if (type != right->get_type()) return false;
+		if (const VectorType* vector_type = type->get_vector()) type = vector_type->get_element_type ();
+		return type == &Type::BOOL;
 	}
 	static Expression* create (Expression* left, Expression* right) {
 		return new And (left, right);
@@ -229,20 +372,32 @@ class Or: public Expression {
 public:
 	Or (Expression* left, Expression* right): left(left), right(right) {}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
-		return &Type::BOOL;
+		return left->get_type ();
 	}
 	bool validate () override {
-		return left->get_type() == &Type::BOOL && right->get_type() == &Type::BOOL;
+		const Type* type = left->get_type ();
+		if (type != right->get_type()) return false;
+		if (const VectorType* vector_type = type->get_vector()) type = vector_type->get_element_type ();
+		return type == &Type::BOOL;
 	}
 	static Expression* create (Expression* left, Expression* right) {
 		return new Or (left, right);
 	}
 };
 
-class Node {
+class Node: public Pooled {
 public:
+	// the line in the source, for debug info and instrumentation
+	int line;
+	Node (): line(0) {
+		profile::count_node ();
+	}
 	virtual void write (Writer&) = 0;
+	virtual void compile (vm::Compiler&) = 0;
+	virtual void analyze (EscapeAnalysis&) = 0;
 };
 
 class ExpressionNode: public Node {
@@ -252,6 +407,8 @@ public:
 	void write (Writer& writer) override {
 		expression->insert (writer);
 	}
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
 };
 
 class Return: public Node {
@@ -259,9 +416,11 @@ class Return: public Node {
 public:
 	Return (Expression* expression = nullptr): expression(expression) {}
 	void write (Writer& writer) override;
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
 };
 
-class Block {
+class Block: public Pooled {
 	std::vector<Node*> nodes;
 	std::vector<Variable*> variables;
 public:
@@ -282,29 +441,78 @@ public:
 		variables.push_back (variable);
 	}
 	void write (Writer& writer);
+	void compile (vm::Compiler& compiler);
+	void analyze (EscapeAnalysis& analysis);
+};
+
+// given with the likely and unlikely keywords in front of a condition
+enum Likelihood {
+	UNKNOWN,
+	LIKELY,
+	UNLIKELY
 };
 
 class If: public Node {
 	Expression* condition;
+	Likelihood likelihood;
 public:
 	Block* if_block;
-	If (Expression* condition): condition(condition) {
+	If (Expression* condition, Likelihood likelihood = UNKNOWN): condition(condition), likelihood(likelihood) {
 		if_block = new Block ();
 	}
 	void write (Writer& writer) override;
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
 };
 
 class While: public Node {
 	Expression* condition;
+	Likelihood likelihood;
 public:
 	Block* block;
-	While (Expression* condition): condition(condition) {
+	While (Expression* condition, Likelihood likelihood = UNKNOWN): condition(condition), likelihood(likelihood) {
 		block = new Block ();
 	}
 	void write (Writer& writer) override;
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
 };
 
-class FunctionDeclaration: public FunctionPrototype {
+// iterates over the integers of a range or over the elements of an array
+class For: public Node {
+public:
+	// the integer or the element
+	Variable* variable;
+	// hidden variables for the current index, the end of the range and the array
+	Variable* index;
+	Variable* end;
+	Variable* array;
+	// the start of the range, null for arrays
+	Expression* start;
+	// the end of the range or the array
+	Expression* expression;
+	Block* block;
+	For (): variable(nullptr), index(nullptr), end(nullptr), array(nullptr), start(nullptr), expression(nullptr) {
+		block = new Block ();
+	}
+	void write (Writer& writer) override;
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
+};
+
+// the heap instances that are allocated while the block is executed are freed at its end
+class Region: public Node {
+public:
+	Block* block;
+	Region () {
+		block = new Block ();
+	}
+	void write (Writer& writer) override;
+	void compile (vm::Compiler& compiler) override;
+	void analyze (EscapeAnalysis& analysis) override;
+};
+
+class FunctionDeclaration: public FunctionPrototype, public Pooled {
 protected:
 	Substring name;
 	std::vector<Variable*> arguments;
@@ -334,11 +542,14 @@ class Function: public FunctionDeclaration {
 	std::vector<Variable*> variables;
 public:
 	Block* block;
-	Function (const Substring& name): FunctionDeclaration(name) {
+	int line;
+	// rarely called, for example to handle errors
+	bool cold;
+	Function (const Substring& name, int line = 0): FunctionDeclaration(name), line(line), cold(false) {
 		block = new Block ();
 	}
 	void add_argument (const Substring& name, const Type* type) {
-		Variable* argument = new Variable (name, type);
+		Variable* argument = new Variable (name, type, line);
 		add_variable (argument);
 		block->add_variable (argument);
 		arguments.push_back (argument);
@@ -347,7 +558,21 @@ public:
 		variable->set_n (variables.size());
 		variables.push_back (variable);
 	}
+	int get_variable_count () const {
+		return variables.size ();
+	}
+	// discards the body so that it can be parsed again
+	void reset () {
+		variables.clear ();
+		block = new Block ();
+		for (Variable* argument: arguments) {
+			add_variable (argument);
+			block->add_variable (argument);
+		}
+	}
 	void write (Writer& writer);
+	void compile (vm::Compiler& compiler);
+	void analyze (EscapeAnalysis& analysis);
 };
 
 class Call: public Expression, public FunctionPrototype {
@@ -370,25 +595,41 @@ public:
 		return_type = type;
 	}
 	writer::Value* insert (Writer& writer);
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
 		return return_type;
 	}
 };
 
-class Class: public Type {
+class Class: public Type, public Pooled {
 	Substring name;
 	std::vector<Variable*> attributes;
 	std::vector<Expression*> default_values;
+	std::vector<Substring> default_sources;
 public:
-	Class (const Substring& name): name(name) {}
+	// no padding between the attributes and Bool attributes packed into bits
+	bool packed;
+	// arrays of the class store their elements as one column per attribute
+	bool soa;
+	Class (const Substring& name): name(name), packed(false), soa(false) {}
 	Substring get_name () const override {
 		return name;
 	}
 	void add_attribute (const Substring& name, Expression* value) {
-		Variable* attribute = new Variable (name, value->get_type());
+		add_attribute (name, value->get_type(), value);
+	}
+	// attributes without a default value have to be initialized explicitly
+	void add_attribute (const Substring& name, const Type* type, Expression* value) {
+		Variable* attribute = new Variable (name, type);
 		attribute->set_n (attributes.size());
 		attributes.push_back (attribute);
 		default_values.push_back (value);
+		default_sources.push_back (Substring(""));
+	}
+	// the source of the default value of the last attribute, for interfaces
+	void set_default_source (const Substring& source) {
+		default_sources.back() = source;
 	}
 	Variable* get_attribute (const Substring& name) const {
 		for (Variable* attribute: attributes) {
@@ -402,6 +643,9 @@ public:
 	const std::vector<Expression*>& get_default_values () const {
 		return default_values;
 	}
+	const std::vector<Substring>& get_default_sources () const {
+		return default_sources;
+	}
 	const Class* get_class () const override {
 		return this;
 	}
@@ -415,7 +659,15 @@ public:
 	void set_attribute_value (Variable* attribute, Expression* value) {
 		attribute_values[attribute->get_n()] = value;
 	}
+	const Variable* get_uninitialized_attribute () const {
+		for (int i = 0; i < attribute_values.size(); ++i) {
+			if (!attribute_values[i]) return _class->get_attributes()[i];
+		}
+		return nullptr;
+	}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	const Type* get_type () override {
 		return _class;
 	}
@@ -427,43 +679,247 @@ class AttributeAccess: public Expression {
 public:
 	AttributeAccess (Expression* expression, const Substring& name): expression(expression), name(name) {}
 	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
 	bool has_address () override { return true; }
 	writer::Value* insert_address (Writer& writer) override;
+	void compile_store (vm::Compiler& compiler, int source) override;
 	const Type* get_type () override {
 		return expression->get_type()->get_class()->get_attribute(name)->get_type();
 	}
 };
 
-class Program {
+// a new array whose elements are initialized with the element expression, which is
+// evaluated again for every element
+class ArrayCreation: public Expression {
+	const ArrayType* type;
+	Expression* length;
+	Expression* element;
+public:
+	ArrayCreation (const ArrayType* type, Expression* length, Expression* element): type(type), length(length), element(element) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return type;
+	}
+};
+
+class ArrayLiteral: public Expression {
+	const ArrayType* type;
+	std::vector<Expression*> elements;
+public:
+	ArrayLiteral (const ArrayType* type): type(type) {}
+	void add_element (Expression* element) {
+		elements.push_back (element);
+	}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return type;
+	}
+};
+
+class Index: public Expression {
+	Expression* array;
+	Expression* index;
+public:
+	// false if the index is known to be inside the bounds of the array
+	bool checked;
+	Index (Expression* array, Expression* index): array(array), index(index), checked(true) {}
+	Expression* get_array () const {
+		return array;
+	}
+	Expression* get_index () const {
+		return index;
+	}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	bool has_address () override { return true; }
+	writer::Value* insert_address (Writer& writer) override;
+	void compile_store (vm::Compiler& compiler, int source) override;
+	const Type* get_type () override {
+		return array->get_type()->get_array()->get_element_type();
+	}
+};
+
+// an attribute of an element of an array of a soa class, the element itself has no address
+class ColumnAccess: public Expression {
+	Index* element;
+	Substring name;
+public:
+	ColumnAccess (Index* element, const Substring& name): element(element), name(name) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	bool has_address () override { return true; }
+	writer::Value* insert_address (Writer& writer) override;
+	void compile_store (vm::Compiler& compiler, int source) override;
+	const Type* get_type () override {
+		return element->get_type()->get_class()->get_attribute(name)->get_type();
+	}
+};
+
+class ArrayLength: public Expression {
+	Expression* array;
+public:
+	ArrayLength (Expression* array): array(array) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	Expression* get_length_of () override {
+		return array;
+	}
+	const Type* get_type () override {
+		return &Type::INT;
+	}
+};
+
+// a vector with the same value in every lane, Int4(x), or with one value per lane, Int4(a b c d)
+class VectorCreation: public Expression {
+	const VectorType* type;
+	std::vector<Expression*> lanes;
+public:
+	VectorCreation (const VectorType* type): type(type) {}
+	void add_lane (Expression* lane) {
+		lanes.push_back (lane);
+	}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return type;
+	}
+};
+
+// a lane of a vector, which is stored by replacing the whole vector
+class Lane: public Expression {
+	Expression* vector;
+	Expression* index;
+public:
+	// false if the index is a constant inside the vector
+	bool checked;
+	Lane (Expression* vector, Expression* index): vector(vector), index(index), checked(true) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	bool has_address () override { return vector->has_address (); }
+	writer::Value* insert_address (Writer& writer) override;
+	void compile_store (vm::Compiler& compiler, int source) override;
+	const Type* get_type () override {
+		return vector->get_type()->get_vector()->get_element_type();
+	}
+};
+
+// combines all lanes of a vector, the operation is add, smin or smax for Int and and or for Bool
+class Reduction: public Expression {
+	const char* operation;
+	Expression* vector;
+public:
+	Reduction (const char* operation, Expression* vector): operation(operation), vector(vector) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return vector->get_type()->get_vector()->get_element_type();
+	}
+};
+
+// the lanes of one or two vectors in any order, the lanes of the second vector follow those of the first one
+class Shuffle: public Expression {
+	const VectorType* type;
+	Expression* left;
+	Expression* right;
+	std::vector<int> indices;
+public:
+	Shuffle (const VectorType* type, Expression* left, Expression* right, const std::vector<int>& indices): type(type), left(left), right(right), indices(indices) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return type;
+	}
+};
+
+// the lanes of the first vector where the mask is true and those of the second one elsewhere
+class Select: public Expression {
+	Expression* mask;
+	Expression* left;
+	Expression* right;
+public:
+	Select (Expression* mask, Expression* left, Expression* right): mask(mask), left(left), right(right) {}
+	writer::Value* insert (Writer& writer) override;
+	int compile (vm::Compiler& compiler) override;
+	int analyze (EscapeAnalysis& analysis) override;
+	const Type* get_type () override {
+		return left->get_type ();
+	}
+};
+
+class Program: public Pooled {
 	std::vector<FunctionDeclaration*> function_declarations;
 	std::vector<Function*> functions;
 	std::vector<Class*> classes;
+	std::map<Substring, std::vector<FunctionDeclaration*>> functions_by_name;
+	std::map<Substring, Class*> classes_by_name;
+	std::vector<Interface*> interfaces;
+	Class* get_imported_class (const Substring& name);
+	const std::vector<FunctionDeclaration*>* get_imported_functions (const Substring& name);
 public:
 	void add_function_declaration (FunctionDeclaration* function_declaration) {
 		function_declarations.push_back (function_declaration);
+		functions_by_name[function_declaration->get_name()].push_back (function_declaration);
 	}
 	void add_function (Function* function) {
 		functions.push_back (function);
+		functions_by_name[function->get_name()].push_back (function);
 	}
-	const Type* get_return_type (const FunctionPrototype* function) {
-		for (FunctionDeclaration* existing_function: function_declarations) {
-			if (*existing_function == *function) return existing_function->get_return_type();
-		}
-		for (Function* existing_function: functions) {
-			if (*existing_function == *function) return existing_function->get_return_type();
+	void add_interface (Interface* interface) {
+		interfaces.push_back (interface);
+	}
+	const std::vector<Interface*>& get_interfaces () const {
+		return interfaces;
+	}
+	FunctionDeclaration* get_function (const FunctionPrototype* function) {
+		const std::vector<FunctionDeclaration*>* candidates = get_functions (function->get_name());
+		if (!candidates) return nullptr;
+		for (FunctionDeclaration* existing_function: *candidates) {
+			if (*existing_function == *function) return existing_function;
 		}
 		return nullptr;
 	}
+	// functions of the program hide imported functions with the same name
+	const std::vector<FunctionDeclaration*>* get_functions (const Substring& name) {
+		auto i = functions_by_name.find (name);
+		if (i != functions_by_name.end()) return &i->second;
+		if (!interfaces.empty()) return get_imported_functions (name);
+		return nullptr;
+	}
+	const std::vector<Function*>& get_functions () const {
+		return functions;
+	}
+	const Type* get_return_type (const FunctionPrototype* function) {
+		FunctionDeclaration* existing_function = get_function (function);
+		if (existing_function) return existing_function->get_return_type();
+		return nullptr;
+	}
 	void add_class (Class* _class) {
 		classes.push_back (_class);
+		classes_by_name[_class->get_name()] = _class;
 	}
 	Class* get_class (const Substring& name) {
-		for (Class* _class: classes) {
-			if (_class->get_name() == name) return _class;
-		}
+		auto i = classes_by_name.find (name);
+		if (i != classes_by_name.end()) return i->second;
+		if (!interfaces.empty()) return get_imported_class (name);
 		return nullptr;
 	}
-	void write (Writer& writer);
+	const std::vector<Class*>& get_classes () const {
+		return classes;
+	}
+	void write (Writer& writer, int jobs = 1, Cache* cache = nullptr);
+	void compile (vm::Compiler& compiler);
 };
 
 }
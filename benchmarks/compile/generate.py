@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+# Generates a large synthetic Rea program to measure how compile time scales.
+# The program has many classes with many attributes, functions with deep
+# expressions, long comment blocks and long call chains.
+
+import argparse
+import random
+
+def generate_class(out, i, attributes):
+	out.append('class C%d {' % i)
+	for j in range(attributes):
+		if i % 4 != 0 and j == 0:
+			# nested instances make attribute accesses go through several classes,
+			# the chains are short because defaults are instantiated inline
+			out.append('    var inner = C%d { a1 = %d }' % (i - 1, j))
+		else:
+			out.append('    var a%d = %d' % (j, j))
+	out.append('    func sum(): Int {')
+	out.append('        return ' + ' + '.join('this.a%d' % j for j in range(1, attributes)))
+	out.append('    }')
+	out.append('}')
+	out.append('')
+
+def generate_expression(rng, depth):
+	if depth == 0:
+		return rng.choice(['a', 'b', 's', str(rng.randrange(100))])
+	op = rng.choice(['+', '-', '*', '%', '/'])
+	left = generate_expression(rng, depth - 1)
+	right = generate_expression(rng, depth - 1) if op not in '%/' else str(rng.randrange(1, 100))
+	return '(%s %s %s)' % (left, op, right)
+
+def generate_comment(out, lines):
+	out.append('/*')
+	for i in range(lines):
+		out.append(' * a long comment block that the lexer has to skip, line %d' % i)
+	out.append(' */')
+
+def generate_function(out, rng, i, classes, depth, comment_lines):
+	if comment_lines:
+		generate_comment(out, comment_lines)
+	out.append('func f%d(a: Int, b: Int): Int {' % i)
+	out.append('    // the body combines loops, branches, instances and calls')
+	out.append('    var s = a')
+	if classes:
+		c = rng.randrange(classes)
+		out.append('    var c = C%d { a1 = a }' % c)
+		out.append('    s = s + c.sum()')
+	out.append('    while s < b * 10 && s > 0 - 100 || false {')
+	out.append('        s = s + %s' % generate_expression(rng, depth))
+	out.append('        if s %% 3 == 0 { s = s + %d }' % (i % 7 + 1))
+	out.append('    }')
+	if i > 0:
+		# every function continues a call chain and calls a random earlier one
+		out.append('    s = s + f%d(s, b) + f%d(b, s)' % (i - 1, rng.randrange(i)))
+	out.append('    return s')
+	out.append('}')
+	out.append('')
+
+def generate(functions, classes, attributes, depth, comment_lines, seed):
+	rng = random.Random(seed)
+	out = []
+	for i in range(classes):
+		generate_class(out, i, attributes)
+	for i in range(functions):
+		generate_function(out, rng, i, classes, depth, comment_lines if i % 10 == 0 else 0)
+	out.append('func main() {')
+	out.append('    f%d(1, 2).print()' % (functions - 1))
+	out.append('}')
+	return '\n'.join(out) + '\n'
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__)
+	parser.add_argument('--functions', type=int, default=1000)
+	parser.add_argument('--classes', type=int, default=None, help='defaults to functions / 20')
+	parser.add_argument('--attributes', type=int, default=8)
+	parser.add_argument('--depth', type=int, default=5, help='depth of the expression trees')
+	parser.add_argument('--comment-lines', type=int, default=50, help='lines of the comment before every tenth function')
+	parser.add_argument('--seed', type=int, default=1)
+	parser.add_argument('-o', '--output', default='-')
+	args = parser.parse_args()
+	classes = args.classes if args.classes is not None else max(1, args.functions // 20)
+	source = generate(args.functions, classes, args.attributes, args.depth, args.comment_lines, args.seed)
+	if args.output == '-':
+		print(source, end='')
+	else:
+		with open(args.output, 'w') as f:
+			f.write(source)
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+
+# Measures the compile throughput of rea on generated programs of growing size
+# and reports lines per second, the time of every phase, the peak memory and
+# how the total time scales with the number of lines.
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+import generate
+
+def parse_report(report):
+	phases = {}
+	counts = {}
+	section = None
+	for line in report.splitlines():
+		fields = line.split()
+		if not fields:
+			section = None
+			continue
+		if fields[1:2] == ['time']:
+			section = fields[0]
+			continue
+		if section == 'phase':
+			if fields[0] == 'total':
+				phases['total'] = float(fields[1])
+			else:
+				phases[' '.join(fields[:-2])] = float(fields[-2])
+		elif section is None and len(fields) >= 2:
+			counts[' '.join(fields[:-1])] = float(fields[-1])
+	return phases, counts
+
+def measure(rea, path, jobs, repeat):
+	best = None
+	for i in range(repeat):
+		result = subprocess.run([rea, '--time-report', '-j', str(jobs), path], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True, check=True)
+		phases, counts = parse_report(result.stderr)
+		if best is None or phases['total'] < best[0]['total']:
+			best = (phases, counts)
+	return best
+
+def fit_exponent(sizes, times):
+	# least squares fit of log(time) = k * log(lines) + c
+	xs = [math.log(x) for x in sizes]
+	ys = [math.log(y) for y in times]
+	n = len(xs)
+	mx = sum(xs) / n
+	my = sum(ys) / n
+	sxx = sum((x - mx) ** 2 for x in xs)
+	sxy = sum((x - mx) * (y - my) for x, y in zip(xs, ys))
+	return sxy / sxx if sxx > 0 else float('nan')
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__)
+	parser.add_argument('--rea', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'rea'))
+	parser.add_argument('--sizes', default='1000,2000,4000,8000', help='numbers of functions')
+	parser.add_argument('--repeat', type=int, default=3, help='the fastest run is reported')
+	parser.add_argument('-j', '--jobs', type=int, default=1)
+	args = parser.parse_args()
+	
+	sizes = [int(size) for size in args.sizes.split(',')]
+	phase_names = ['read', 'declarations', 'function bodies', 'codegen', 'emission']
+	print('%10s %10s %12s' % ('functions', 'lines', 'lines/s') + ''.join(' %16s' % name for name in phase_names) + ' %12s %14s' % ('total (ms)', 'peak RSS (MB)'))
+	lines = []
+	totals = []
+	with tempfile.TemporaryDirectory() as directory:
+		for size in sizes:
+			path = os.path.join(directory, 'program%d.rea' % size)
+			source = generate.generate(size, max(1, size // 20), 8, 5, 50, 1)
+			with open(path, 'w') as f:
+				f.write(source)
+			phases, counts = measure(args.rea, path, args.jobs, args.repeat)
+			line_count = source.count('\n')
+			total = phases['total']
+			lines.append(line_count)
+			totals.append(total)
+			print('%10d %10d %12.0f' % (size, line_count, line_count / (total / 1000)) + ''.join(' %16.1f' % phases.get(name, 0) for name in phase_names) + ' %12.1f %14.1f' % (total, counts.get('peak RSS bytes', 0) / 1e6))
+	if len(sizes) > 1:
+		# 1 means linear, larger values point to a superlinear algorithm
+		print('scaling exponent: %.2f' % fit_exponent(lines, totals))
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,200 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+// Checks that Document reports the same diagnostics as parsing the edited text
+// from scratch, that edits inside a function body reuse the rest of the syntax
+// tree, that stores which let an allocation outlive its region are reported, and
+// measures how long an edit inside a function takes on a large generated file.
+
+#include "document.hpp"
+#include "profile.hpp"
+#include <algorithm>
+
+namespace {
+
+int failures = 0;
+
+void check (bool condition, const char* what) {
+	if (condition) return;
+	fprintf (stderr, "FAIL: %s\n", what);
+	++failures;
+}
+
+bool is_equal (const Diagnostic& a, const Diagnostic& b) {
+	return a.line == b.line && a.column == b.column && a.message == b.message && a.source == b.source;
+}
+
+// the diagnostics after an edit must be those of the edited text
+void check_diagnostics (const Document& document, const char* what) {
+	Document fresh (document.get_text());
+	const std::vector<Diagnostic> expected = fresh.get_diagnostics ();
+	const std::vector<Diagnostic> actual = document.get_diagnostics ();
+	if (actual.size() == expected.size() && std::equal(actual.begin(), actual.end(), expected.begin(), is_equal)) return;
+	fprintf (stderr, "FAIL: %s\n", what);
+	for (const Diagnostic& diagnostic: actual) fprintf (stderr, "  got line %d column %d: %s\n", diagnostic.line, diagnostic.column, diagnostic.message.c_str());
+	for (const Diagnostic& diagnostic: expected) fprintf (stderr, "  expected line %d column %d: %s\n", diagnostic.line, diagnostic.column, diagnostic.message.c_str());
+	++failures;
+}
+
+std::vector<ast::Block*> get_blocks (const Document& document) {
+	std::vector<ast::Block*> blocks;
+	if (Program* program = document.get_program()) {
+		for (Function* function: program->get_functions()) blocks.push_back (function->block);
+	}
+	return blocks;
+}
+
+// applies an edit and checks which bodies were parsed again
+void edit (Document& document, const char* search, const char* replacement, int reparsed, const char* what) {
+	const std::string& text = document.get_text ();
+	const size_t offset = text.find (search);
+	if (offset == std::string::npos) {
+		fprintf (stderr, "FAIL: %s: '%s' not found\n", what, search);
+		++failures;
+		return;
+	}
+	Program* program = document.get_program ();
+	const std::vector<ast::Block*> before = get_blocks (document);
+	document.edit (offset, strlen(search), replacement);
+	check_diagnostics (document, what);
+	if (reparsed < 0) return;
+	// an edit inside a body keeps the program and all other bodies
+	const std::vector<ast::Block*> after = get_blocks (document);
+	check (document.get_program() == program, what);
+	check (before.size() == after.size(), what);
+	for (int i = 0; i < before.size() && i < after.size(); ++i) {
+		check ((before[i] != after[i]) == (i == reparsed), what);
+	}
+}
+
+void test_edits () {
+	Document document (
+		"func f(a: Int): Int {\n"
+		"    return a\n"
+		"}\n"
+		"\n"
+		"func g(a: Int): Int {\n"
+		"    return a + true\n"
+		"}\n"
+		"func h(a: Int): Int { return 2 * a } func k(a: Int): Int { return a + false }\n"
+	);
+	check_diagnostics (document, "initial diagnostics");
+	if (document.get_diagnostics().size() != 2) {
+		fprintf (stderr, "FAIL: expected one diagnostic in g and one in k\n");
+		++failures;
+		return;
+	}
+	const int line = document.get_diagnostics()[0].line;
+	edit (document, "return a\n", "var b = a\n    var c = b\n    return c\n", 0, "lines added to f");
+	check (document.get_diagnostics()[0].line == line + 2, "the diagnostic of g moves with the lines of f");
+	edit (document, "var c = b\n    return c", "return b", 0, "a line removed from f");
+	edit (document, "2 * a", "2000 * a", 2, "an edit on the line of another body");
+	edit (document, "a + true", "a + 1", 1, "an error fixed in g");
+	edit (document, "return b", "return b + true", 0, "an error added to f");
+	edit (document, "func g", "func g2", -1, "a function renamed");
+	edit (document, "return a + 1\n}", "return a + 1\n}\n}", -1, "a closing brace added");
+	edit (document, "}\n}", "}", -1, "a closing brace removed");
+	edit (document, "func f(a: Int)", "func f(a: Bool)", -1, "an argument type changed");
+}
+
+// stores that let an allocation outlive its region are errors
+void check_region (const char* body, int line, const char* what) {
+	const std::string text = std::string (
+		"class Node {\n"
+		"    var value = 0\n"
+		"}\n"
+		"class List {\n"
+		"    var head = Node {}\n"
+		"    var items = [Node](0)\n"
+		"}\n"
+		"func attach(l: List) {\n"
+		"    l.head = Node {}\n"
+		"}\n"
+		"func f(list: List, nodes: [Node]) {\n"
+		"    var outer = Node {}\n"
+		"    region {\n"
+	) + body + "    }\n}\n";
+	Document document (text);
+	const std::vector<Diagnostic>& diagnostics = document.get_diagnostics ();
+	if (line == 0) check (diagnostics.empty(), what);
+	// relative to the first line of the body
+	else check (diagnostics.size() == 1 && diagnostics[0].line == 13 + line && diagnostics[0].message.find("region") != std::string::npos, what);
+}
+
+void test_regions () {
+	check_region ("        var l = List {}\n        l.head = Node {}\n        l.items = [Node](2)\n        l.items[0] = l.head\n        attach(l)\n", 0, "stores inside a region");
+	check_region ("        var n = list.head\n        outer.value = n.value\n", 0, "reads from outside of a region");
+	check_region ("        var n = Node {}\n        list.head = n\n", 2, "an instance stored in an argument");
+	check_region ("        nodes[0] = Node {}\n", 1, "an instance stored in an argument array");
+	check_region ("        list.items = [Node](1)\n", 1, "an array stored in an argument");
+	check_region ("        outer = Node {}\n", 1, "an instance stored in a variable from outside");
+	check_region ("        var alias = list\n        if true {\n            alias.head = Node {}\n        }\n", 3, "an instance stored through an alias");
+	check_region ("        region {\n            var l = List {}\n        }\n        var l = List {}\n        region {\n            l.head = Node {}\n        }\n", 6, "an instance stored in an outer region");
+	check_region ("        attach(list)\n", 1, "an argument passed to a call that allocates");
+}
+
+// a file with many functions, like the programs of benchmarks/compile
+std::string generate (int functions) {
+	std::string text;
+	for (int i = 0; i < functions; ++i) {
+		const std::string n = std::to_string (i);
+		text += "func f" + n + "(a: Int, b: Int): Int {\n";
+		text += "    var s = a * " + n + " + b\n";
+		text += "    while s > 100 {\n";
+		text += "        s = s / 2 - b % 7\n";
+		text += "    }\n";
+		text += "    return s\n";
+		text += "}\n\n";
+	}
+	return text;
+}
+
+void measure_edits (int functions, int edits) {
+	const std::string text = generate (functions);
+	double start = profile::get_time ();
+	Document document (text);
+	// in microseconds
+	const double parse_time = profile::get_time () - start;
+	check (document.get_diagnostics().empty(), "the generated file has no errors");
+	// type a digit and delete it again inside a function in the middle of the file
+	const size_t offset = document.get_text().find ("var s = a * " + std::to_string(functions / 2)) + 8;
+	start = profile::get_time ();
+	for (int i = 0; i < edits; ++i) {
+		document.edit (offset, 0, "1");
+		document.edit (offset, 1, "");
+	}
+	const double edit_time = (profile::get_time () - start) / (2 * edits);
+	check (document.get_text() == text, "the text after the edits");
+	const int lines = std::count (text.begin(), text.end(), '\n');
+	printf ("%d lines: full parse %.2f ms, edit inside a function %.4f ms\n", lines, parse_time / 1000, edit_time / 1000);
+}
+
+}
+
+int main (int argc, char** argv) {
+	test_edits ();
+	test_regions ();
+	const int functions = argc > 1 ? atoi (argv[1]) : 20000;
+	measure_edits (functions, 1000);
+	if (failures) {
+		fprintf (stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf ("all checks passed\n");
+	return EXIT_SUCCESS;
+}
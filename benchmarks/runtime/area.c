@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include <stdio.h>
+
+// the C version of examples/area.rea
+
+typedef struct {
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+} Rectangle;
+
+int32_t area (Rectangle* this) {
+	return this->width * this->height;
+}
+
+int main () {
+	Rectangle rectangle = {0, 0, 6, 7};
+	printf ("%d\n", area (&rectangle));
+}
@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main () {
+	// sums over an array
+	const int32_t length = 1000000;
+	int32_t* a = calloc (length, sizeof(int32_t));
+	for (int32_t i = 0; i < length; ++i) {
+		a[i] = i % 100;
+	}
+	int32_t total = 0;
+	for (int32_t round = 0; round < 2000; ++round) {
+		int32_t sum = 0;
+		for (int32_t i = 0; i < length; ++i) {
+			sum = sum + a[i];
+		}
+		total = (total + sum + round) % 1000003;
+	}
+	printf ("%d\n", total);
+}
@@ -0,0 +1,19 @@
+#include <stdint.h>
+#include <stdio.h>
+
+int32_t add (int32_t a, int32_t b) {
+	return a + b;
+}
+
+int32_t step (int32_t x, int32_t i) {
+	// small functions that are called very often
+	return add (x * 3, i) % 1000003;
+}
+
+int main () {
+	int32_t x = 1;
+	for (int32_t i = 0; i < 50000000; ++i) {
+		x = step (x, i);
+	}
+	printf ("%d\n", x);
+}
@@ -0,0 +1,26 @@
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+	int32_t x;
+	int32_t y;
+} Vector;
+
+int32_t dot (Vector* this, Vector* other) {
+	return this->x * other->x + this->y * other->y;
+}
+
+int32_t combine (int32_t x, int32_t y) {
+	// instances that only live during the call
+	Vector a = {x, y};
+	Vector b = {y, x};
+	return dot (&a, &b) + a.x;
+}
+
+int main () {
+	int32_t total = 0;
+	for (int32_t i = 0; i < 20000000; ++i) {
+		total = (total + combine (i % 100, i % 37)) % 1000003;
+	}
+	printf ("%d\n", total);
+}
@@ -0,0 +1,14 @@
+#include <stdint.h>
+#include <stdio.h>
+
+int32_t fib (int32_t n) {
+	// recursion
+	if (n < 2) {
+		return n;
+	}
+	return fib (n - 1) + fib (n - 2);
+}
+
+int main () {
+	printf ("%d\n", fib (32));
+}
@@ -0,0 +1,13 @@
+#include <stdint.h>
+#include <stdio.h>
+
+int main () {
+	// nested loops with arithmetic
+	int32_t total = 0;
+	for (int32_t i = 0; i < 20000; ++i) {
+		for (int32_t j = 0; j < 20000; ++j) {
+			total = (total + i * j) % 1000003;
+		}
+	}
+	printf ("%d\n", total);
+}
@@ -0,0 +1,25 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// the C version of examples/primes.rea
+
+bool is_prime (int32_t n) {
+	for (int32_t i = 2; i * i <= n; ++i) {
+		if (n % i == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main () {
+	// print the first 10 primes greater than one million
+	int32_t n = 0;
+	for (int32_t i = 1000000; n < 10; ++i) {
+		if (is_prime (i)) {
+			printf ("%d\n", i);
+			++n;
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+# Measures how fast the code generated by rea runs compared to hand-written C.
+# Every kernel is compiled with the same clang flags as its C equivalent, both
+# outputs are compared, and the fastest of several runs is reported together
+# with the slowdown ratio and, if perf is available, the instruction counts.
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+directory = os.path.dirname(os.path.abspath(__file__))
+root = os.path.join(directory, '..', '..')
+
+# the Rea kernel and its C equivalent
+kernels = [
+	('primes', os.path.join(root, 'examples', 'primes.rea'), os.path.join(directory, 'primes.c')),
+	('area', os.path.join(root, 'examples', 'area.rea'), os.path.join(directory, 'area.c')),
+	('loops', os.path.join(directory, 'loops.rea'), os.path.join(directory, 'loops.c')),
+	('classes', os.path.join(directory, 'classes.rea'), os.path.join(directory, 'classes.c')),
+	('fib', os.path.join(directory, 'fib.rea'), os.path.join(directory, 'fib.c')),
+	('calls', os.path.join(directory, 'calls.rea'), os.path.join(directory, 'calls.c')),
+	('arrays', os.path.join(directory, 'arrays.rea'), os.path.join(directory, 'arrays.c')),
+]
+
+def build_rea(rea, cc, flags, source, output):
+	ir = output + '.ll'
+	with open(ir, 'w') as f:
+		subprocess.run([rea, source], stdout=f, check=True)
+	subprocess.run([cc] + flags + ['-o', output, ir, os.path.join(root, 'stdlib.c')], check=True)
+
+def build_c(cc, flags, source, output):
+	subprocess.run([cc] + flags + ['-o', output, source], check=True)
+
+def measure(executable, repeat):
+	best = None
+	output = None
+	for i in range(repeat):
+		start = time.perf_counter()
+		# the exit status is not checked since main returns void in Rea
+		result = subprocess.run([executable], stdout=subprocess.PIPE, universal_newlines=True)
+		elapsed = time.perf_counter() - start
+		output = result.stdout
+		if best is None or elapsed < best:
+			best = elapsed
+	return best, output
+
+def count_instructions(executable):
+	result = subprocess.run(['perf', 'stat', '-x,', '-e', 'instructions', executable], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+	for line in result.stderr.splitlines():
+		fields = line.split(',')
+		if len(fields) > 2 and fields[2].startswith('instructions'):
+			try:
+				return int(fields[0])
+			except ValueError:
+				return None
+	return None
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__)
+	parser.add_argument('--rea', default=os.path.join(root, 'rea'))
+	parser.add_argument('--cc', default=os.environ.get('CC', 'clang'))
+	parser.add_argument('--flags', default='-O2', help='the flags used for both the Rea and the C version')
+	parser.add_argument('--repeat', type=int, default=5, help='the fastest run is reported')
+	parser.add_argument('kernels', nargs='*', help='the kernels to run, all by default')
+	args = parser.parse_args()
+	
+	flags = args.flags.split()
+	perf = shutil.which('perf') is not None
+	selected = [kernel for kernel in kernels if not args.kernels or kernel[0] in args.kernels]
+	print('%10s %12s %12s %10s' % ('kernel', 'rea (ms)', 'C (ms)', 'slowdown') + (' %16s %16s' % ('rea instr', 'C instr') if perf else ''))
+	failed = False
+	with tempfile.TemporaryDirectory() as temporary:
+		for name, rea_source, c_source in selected:
+			rea_executable = os.path.join(temporary, name + '-rea')
+			c_executable = os.path.join(temporary, name + '-c')
+			build_rea(args.rea, args.cc, flags, rea_source, rea_executable)
+			build_c(args.cc, flags, c_source, c_executable)
+			rea_time, rea_output = measure(rea_executable, args.repeat)
+			c_time, c_output = measure(c_executable, args.repeat)
+			if rea_output != c_output:
+				print('%10s: the outputs differ' % name, file=sys.stderr)
+				failed = True
+				continue
+			line = '%10s %12.1f %12.1f %10.2f' % (name, rea_time * 1000, c_time * 1000, rea_time / c_time)
+			if perf:
+				rea_instructions = count_instructions(rea_executable)
+				c_instructions = count_instructions(c_executable)
+				line += ' %16s %16s' % (rea_instructions or '-', c_instructions or '-')
+			print(line)
+	if not perf:
+		print('perf not found, instruction counts are not reported')
+	if failed:
+		sys.exit(1)
+
+if __name__ == '__main__':
+	main()
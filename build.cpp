@@ -0,0 +1,397 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "build.hpp"
+#include "foundation.hpp"
+#include "parallel.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+std::string to_hex (uint64_t n) {
+	char buffer[17];
+	snprintf (buffer, sizeof(buffer), "%016llx", (unsigned long long)n);
+	return buffer;
+}
+
+bool exists (const std::string& path) {
+	struct stat s;
+	return stat (path.c_str(), &s) == 0;
+}
+
+std::string get_executable (const char* fallback) {
+	char buffer[4096];
+	ssize_t length = readlink ("/proc/self/exe", buffer, sizeof(buffer) - 1);
+	if (length < 0) return fallback;
+	return std::string (buffer, length);
+}
+
+std::string get_directory (const std::string& path) {
+	size_t slash = path.rfind ('/');
+	if (slash == std::string::npos) return ".";
+	return path.substr (0, slash);
+}
+
+bool has_suffix (const char* string, const char* suffix) {
+	const size_t length = strlen (string);
+	const size_t suffix_length = strlen (suffix);
+	return length >= suffix_length && strcmp (string + length - suffix_length, suffix) == 0;
+}
+
+bool run (const std::vector<std::string>& arguments) {
+	std::vector<char*> argv;
+	for (const std::string& argument: arguments) argv.push_back ((char*)argument.c_str());
+	argv.push_back (nullptr);
+	pid_t pid;
+	if (posix_spawnp (&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+		fprintf (stderr, "error: cannot run '%s'\n", argv[0]);
+		return false;
+	}
+	int status;
+	if (waitpid (pid, &status, 0) < 0) return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+class Build {
+	struct Object {
+		int source;
+		// the intermediate IR file, empty for C sources
+		std::string ir;
+		std::string path;
+	};
+	std::vector<const char*> inputs;
+	// the interfaces that every input is compiled with, from --interface=
+	std::vector<std::string> interfaces;
+	// the cached interfaces of the inputs, so that they can use each other
+	std::vector<std::string> input_interfaces;
+	// objects and archives, like libraries that are used through an interface
+	std::vector<std::string> libraries;
+	std::string output;
+	std::string optimization;
+	std::string debug_info;
+	std::string cache;
+	std::string stdlib;
+	std::string rea;
+	std::string clang;
+	int jobs;
+	int shards;
+	bool thin_lto;
+	bool instrument;
+	bool optimize_layout;
+	std::vector<std::string> get_interfaces (int input, int count) const;
+	uint64_t get_key (const char* kind, const char* path, const std::vector<std::string>& interfaces);
+	std::vector<std::string> get_flags () const;
+	bool emit_interface (int input);
+	bool compile_rea (int input, const std::string& ir);
+	bool compile (const char* language, const std::string& input, const std::string& object);
+	bool link (const std::vector<Object>& objects);
+	int compile_and_link ();
+public:
+	Build ();
+	bool parse_arguments (int argc, char** argv);
+	int run ();
+};
+
+Build::Build (): output("a.out"), optimization("-O2"), cache(".rea-cache"), jobs(std::thread::hardware_concurrency()), shards(1), thin_lto(false), instrument(false), optimize_layout(false) {
+	rea = get_executable ("rea");
+	stdlib = get_directory(rea) + "/stdlib.c";
+	const char* cc = getenv ("CC");
+	clang = cc ? cc : "clang";
+	if (jobs < 1) jobs = 1;
+}
+
+bool Build::parse_arguments (int argc, char** argv) {
+	for (int i = 0; i < argc; ++i) {
+		const char* argument = argv[i];
+		if (strncmp (argument, "-j", 2) == 0) {
+			const char* value = argument[2] ? argument + 2 : (i + 1 < argc ? argv[++i] : "");
+			jobs = atoi (value);
+			if (jobs < 1) {
+				fprintf (stderr, "error: invalid number of jobs '%s'\n", value);
+				return false;
+			}
+		}
+		else if (strncmp (argument, "-O", 2) == 0) {
+			optimization = argument;
+		}
+		else if (strcmp (argument, "-g") == 0 || strcmp (argument, "-gline-tables-only") == 0) {
+			debug_info = argument;
+		}
+		else if (strncmp (argument, "--shards=", 9) == 0) {
+			shards = atoi (argument + 9);
+			if (shards < 1) {
+				fprintf (stderr, "error: invalid number of shards '%s'\n", argument + 9);
+				return false;
+			}
+		}
+		else if (strcmp (argument, "--thin-lto") == 0) {
+			thin_lto = true;
+		}
+		else if (strcmp (argument, "--instrument") == 0) {
+			instrument = true;
+		}
+		else if (strcmp (argument, "--optimize-layout") == 0) {
+			optimize_layout = true;
+		}
+		else if (strncmp (argument, "--interface=", 12) == 0) {
+			interfaces.push_back (argument + 12);
+		}
+		else if ((strcmp (argument, "-o") == 0 || strcmp (argument, "--cache") == 0 || strcmp (argument, "--stdlib") == 0) && i + 1 < argc) {
+			std::string& option = argument[1] == 'o' ? output : strcmp (argument, "--cache") == 0 ? cache : stdlib;
+			option = argv[++i];
+		}
+		else if (argument[0] == '-') {
+			fprintf (stderr, "error: unknown option '%s'\n", argument);
+			return false;
+		}
+		else if (has_suffix (argument, ".o") || has_suffix (argument, ".a")) {
+			libraries.push_back (argument);
+		}
+		else {
+			inputs.push_back (argument);
+		}
+	}
+	if (inputs.empty()) {
+		fprintf (stderr, "error: no input files\n");
+		return false;
+	}
+	return true;
+}
+
+// the interfaces of --interface= and of the first count inputs except the given one
+std::vector<std::string> Build::get_interfaces (int input, int count) const {
+	std::vector<std::string> result (interfaces);
+	for (int i = 0; i < count; ++i) {
+		if (i != input) result.push_back (input_interfaces[i]);
+	}
+	return result;
+}
+
+// objects and interfaces are cached by a hash of their source, the interfaces they use, the flags and the compiler that produced them
+uint64_t Build::get_key (const char* kind, const char* path, const std::vector<std::string>& interfaces) {
+	String source (path);
+	if (!source.get_data()) return 0;
+	Hash hash;
+	hash.add (kind);
+	hash.add (source.get_data());
+	for (const std::string& interface: interfaces) {
+		// interfaces are binary, so they are hashed by their bytes
+		FILE* file = fopen (interface.c_str(), "rb");
+		if (!file) {
+			fprintf (stderr, "error: cannot open file '%s'\n", interface.c_str());
+			return 0;
+		}
+		char buffer[4096];
+		size_t size;
+		while ((size = fread (buffer, 1, sizeof(buffer), file)) > 0) hash.add (buffer, size);
+		fclose (file);
+		hash.add ((uint64_t)0);
+	}
+	// interfaces only depend on rea, C sources only on clang and its flags
+	if (strcmp (kind, "reai") != 0) {
+		for (const std::string& flag: get_flags()) hash.add (flag.c_str());
+		hash.add (clang.c_str());
+	}
+	if (strcmp (kind, "rea") == 0) {
+		hash.add ((uint64_t)shards);
+		hash.add ((uint64_t)instrument);
+		hash.add ((uint64_t)optimize_layout);
+	}
+	struct stat s;
+	if (strcmp (kind, "c") != 0 && stat (rea.c_str(), &s) == 0) {
+		hash.add ((uint64_t)s.st_size);
+		hash.add ((uint64_t)s.st_mtime);
+	}
+	return hash.get ();
+}
+
+std::vector<std::string> Build::get_flags () const {
+	std::vector<std::string> flags {optimization};
+	if (!debug_info.empty()) flags.push_back (debug_info);
+	if (thin_lto) flags.push_back ("-flto=thin");
+	return flags;
+}
+
+// The declarations of an input, which may use the classes of the inputs before it.
+// The function bodies are not parsed, so they can use every other input.
+bool Build::emit_interface (int input) {
+	const std::string& interface = input_interfaces[input];
+	std::string temporary = interface + ".tmp" + std::to_string (getpid());
+	std::vector<std::string> arguments {rea, inputs[input], "--interface-only", "--emit-interface=" + temporary};
+	for (const std::string& interface: get_interfaces(input, input)) arguments.push_back ("--interface=" + interface);
+	bool result = ::run (arguments) && rename (temporary.c_str(), interface.c_str()) == 0;
+	if (!result) unlink (temporary.c_str());
+	return result;
+}
+
+bool Build::compile_rea (int input, const std::string& ir) {
+	// unchanged functions are reused from earlier compilations of the same file
+	std::vector<std::string> arguments {rea, inputs[input], "-o", ir, "--cache=" + cache + "/functions"};
+	for (const std::string& interface: get_interfaces(input, inputs.size())) arguments.push_back ("--interface=" + interface);
+	if (shards > 1) arguments.push_back ("--shards=" + std::to_string(shards));
+	if (instrument) arguments.push_back ("--instrument");
+	if (optimize_layout) arguments.push_back ("--optimize-layout");
+	if (!debug_info.empty()) arguments.push_back (debug_info);
+	return ::run (arguments);
+}
+
+bool Build::compile (const char* language, const std::string& input, const std::string& object) {
+	std::string temporary = object + ".tmp" + std::to_string (getpid());
+	std::vector<std::string> arguments {clang, "-c", "-x", language, input, "-o", temporary};
+	for (const std::string& flag: get_flags()) arguments.push_back (flag);
+	bool result = ::run (arguments) && rename (temporary.c_str(), object.c_str()) == 0;
+	if (!result) unlink (temporary.c_str());
+	return result;
+}
+
+// the executable is only linked again if it was last linked from different objects
+bool Build::link (const std::vector<Object>& objects) {
+	Hash hash;
+	for (const Object& object: objects) hash.add (object.path.c_str());
+	// libraries can change without changing their path
+	for (const std::string& library: libraries) {
+		hash.add (library.c_str());
+		struct stat s;
+		if (stat (library.c_str(), &s) == 0) {
+			hash.add ((uint64_t)s.st_size);
+			hash.add ((uint64_t)s.st_mtime);
+		}
+	}
+	for (const std::string& flag: get_flags()) hash.add (flag.c_str());
+	std::string key = to_hex (hash.get());
+	Hash output_hash;
+	output_hash.add (output.c_str());
+	std::string stamp = cache + "/" + to_hex(output_hash.get()) + ".link";
+	if (exists(output) && exists(stamp)) {
+		String previous (stamp.c_str());
+		if (previous.get_data() && key == previous.get_data()) return true;
+	}
+	unlink (stamp.c_str());
+	std::vector<std::string> arguments {clang, "-o", output};
+	for (const std::string& flag: get_flags()) arguments.push_back (flag);
+	for (const Object& object: objects) arguments.push_back (object.path);
+	for (const std::string& library: libraries) arguments.push_back (library);
+	if (!::run (arguments)) return false;
+	FILE* file = fopen (stamp.c_str(), "w");
+	if (file) {
+		fputs (key.c_str(), file);
+		fclose (file);
+	}
+	return true;
+}
+
+int Build::run () {
+	if (mkdir (cache.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf (stderr, "error: cannot create cache directory '%s'\n", cache.c_str());
+		return EXIT_FAILURE;
+	}
+	if (!exists(stdlib)) {
+		fprintf (stderr, "error: cannot find '%s', use --stdlib\n", stdlib.c_str());
+		return EXIT_FAILURE;
+	}
+	
+	// the inputs can use each other through their interfaces, which are written in order
+	if (inputs.size() > 1) {
+		for (int i = 0; i < inputs.size(); ++i) {
+			uint64_t key = get_key ("reai", inputs[i], get_interfaces(i, i));
+			if (key == 0) return EXIT_FAILURE;
+			input_interfaces.push_back (cache + "/" + to_hex(key) + ".reai");
+			if (!exists(input_interfaces[i]) && !emit_interface(i)) {
+				fprintf (stderr, "error: cannot compile '%s'\n", inputs[i]);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return compile_and_link ();
+}
+
+int Build::compile_and_link () {
+	// the standard library is compiled like any other input
+	std::vector<const char*> sources (inputs);
+	sources.push_back (stdlib.c_str());
+	std::vector<Object> objects;
+	std::vector<std::string> front_ends (inputs.size());
+	for (int i = 0; i < sources.size(); ++i) {
+		const bool is_rea = i < inputs.size ();
+		uint64_t key = get_key (is_rea ? "rea" : "c", sources[i], is_rea ? get_interfaces(i, inputs.size()) : std::vector<std::string>());
+		if (key == 0) return EXIT_FAILURE;
+		std::string base = cache + "/" + to_hex(key);
+		std::string ir = base + ".tmp" + std::to_string(getpid());
+		const int count = is_rea ? shards : 1;
+		for (int shard = 0; shard < count; ++shard) {
+			Object object;
+			object.source = i;
+			object.path = count > 1 ? base + "." + std::to_string(shard) + ".o" : base + ".o";
+			if (is_rea) object.ir = count > 1 ? ir + "." + std::to_string(shard) + ".ll" : ir + ".ll";
+			objects.push_back (object);
+			if (is_rea && !exists(object.path)) front_ends[i] = ir + ".ll";
+		}
+	}
+	
+	std::atomic<bool> success (true);
+	
+	// front ends
+	parallel_for (jobs, inputs.size(), [&] (int i) {
+		if (front_ends[i].empty()) return;
+		if (!compile_rea (i, front_ends[i])) {
+			fprintf (stderr, "error: cannot compile '%s'\n", sources[i]);
+			success = false;
+		}
+	});
+	if (!success) {
+		for (const Object& object: objects) {
+			if (!object.ir.empty()) unlink (object.ir.c_str());
+		}
+		return EXIT_FAILURE;
+	}
+	
+	// back ends, one per shard
+	parallel_for (jobs, objects.size(), [&] (int i) {
+		const Object& object = objects[i];
+		bool result = exists(object.path) || (object.ir.empty() ? compile ("c", sources[object.source], object.path) : compile ("ir", object.ir, object.path));
+		// the front end writes all shards, also those whose object is cached
+		if (!object.ir.empty()) unlink (object.ir.c_str());
+		if (!result) {
+			fprintf (stderr, "error: cannot compile '%s'\n", sources[object.source]);
+			success = false;
+		}
+	});
+	if (!success) return EXIT_FAILURE;
+	
+	if (!link (objects)) {
+		fprintf (stderr, "error: cannot link '%s'\n", output.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+}
+
+int build (int argc, char** argv) {
+	Build build;
+	if (!build.parse_arguments (argc, argv)) return EXIT_FAILURE;
+	return build.run ();
+}
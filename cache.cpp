@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "cache.hpp"
+#include "writer.hpp"
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// an entry consists of the size of the function, the functions it calls and its code:
+// ; size 12
+// ; call fib.Int
+// define i32 @fib.Int(i32) nounwind {
+// ...
+
+Cache::Cache (const char* directory): directory(directory) {
+	if (mkdir (directory, 0755) != 0 && errno != EEXIST) {
+		fprintf (stderr, "warning: cannot create cache directory '%s'\n", directory);
+	}
+	// the code depends on the compiler that generated it
+	struct stat s;
+	if (stat ("/proc/self/exe", &s) == 0) {
+		options.add ((uint64_t)s.st_size);
+		options.add ((uint64_t)s.st_mtime);
+	}
+}
+
+std::string Cache::get_path (uint64_t key) const {
+	char name[32];
+	snprintf (name, sizeof(name), "/%016llx.ll", (unsigned long long)key);
+	return directory + name;
+}
+
+bool Cache::load (ast::Function* function, uint64_t key) {
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		keys[function] = key;
+	}
+	FILE* file = fopen (get_path(key).c_str(), "r");
+	if (!file) return false;
+	char* text;
+	size_t length;
+	FILE* stream = open_memstream (&text, &length);
+	char buffer[4096];
+	size_t n;
+	while ((n = fread (buffer, 1, sizeof(buffer), file)) > 0) fwrite (buffer, 1, n, stream);
+	fclose (stream);
+	fclose (file);
+	
+	int size = -1;
+	std::vector<std::string> callees;
+	char* line = text;
+	while (strncmp (line, "; ", 2) == 0) {
+		char* end = strchr (line, '\n');
+		if (!end) break;
+		if (strncmp (line, "; size ", 7) == 0) size = atoi (line + 7);
+		else if (strncmp (line, "; call ", 7) == 0) callees.push_back (std::string(line + 7, end));
+		line = end + 1;
+	}
+	if (size < 0) {
+		free (text);
+		return false;
+	}
+	writer::Function* result = new writer::Function (function, line, length - (line - text), size, callees);
+	std::lock_guard<std::mutex> lock (mutex);
+	functions[function] = result;
+	return true;
+}
+
+writer::Function* Cache::get_function (const ast::Function* function) {
+	auto i = functions.find (function);
+	if (i == functions.end()) return nullptr;
+	return i->second;
+}
+
+void Cache::store (const writer::Function* function) {
+	auto i = keys.find (function->function);
+	if (i == keys.end()) return;
+	std::string path = get_path (i->second);
+	std::string temporary = path + ".tmp" + std::to_string (getpid());
+	FILE* file = fopen (temporary.c_str(), "w");
+	if (!file) return;
+	fprintf (file, "; size %d\n", function->get_size());
+	for (const std::string& callee: function->callees) fprintf (file, "; call %s\n", callee.c_str());
+	fwrite (function->get_text(), 1, function->get_length(), file);
+	bool success = fclose (file) == 0;
+	if (!success || rename (temporary.c_str(), path.c_str()) != 0) unlink (temporary.c_str());
+}
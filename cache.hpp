@@ -0,0 +1,53 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "ast.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace writer {
+	class Function;
+}
+
+// caches the generated code of functions across compilations
+class Cache {
+	std::string directory;
+	Hash options;
+	std::mutex mutex;
+	std::map<const ast::Function*, uint64_t> keys;
+	std::map<const ast::Function*, writer::Function*> functions;
+	std::string get_path (uint64_t key) const;
+public:
+	Cache (const char* directory);
+	// options that change the generated code must be part of the key
+	void add_option (const char* option) {
+		options.add (option);
+	}
+	void add_option (uint64_t option) {
+		options.add (option);
+	}
+	uint64_t get_seed () const {
+		return options.get ();
+	}
+	// remembers the key of the function and returns true if its code is cached
+	bool load (ast::Function* function, uint64_t key);
+	writer::Function* get_function (const ast::Function* function);
+	void store (const writer::Function* function);
+};
@@ -0,0 +1,134 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "document.hpp"
+#include <algorithm>
+
+Document::Document (const std::string& text, const std::vector<Interface*>& interfaces): text(text), source(nullptr), interfaces(interfaces), pool(nullptr), program(nullptr) {
+	parse ();
+}
+
+Document::~Document () {
+	clear ();
+}
+
+void Document::clear () {
+	for (Body& body: bodies) {
+		free (body.source);
+		delete body.pool;
+	}
+	bodies.clear ();
+	diagnostics.clear ();
+	delete pool;
+	pool = nullptr;
+	free (source);
+	source = nullptr;
+	program = nullptr;
+}
+
+void Document::parse () {
+	clear ();
+	// the syntax tree refers to the source, so it needs a copy that does not change
+	source = strdup (text.c_str());
+	pool = new Pool ();
+	Pool::Scope scope (pool);
+	Cursor cursor (source);
+	Parser parser (cursor);
+	try {
+		program = parser.parse_interface (interfaces);
+	}
+	catch (const Diagnostic& diagnostic) {
+		diagnostics.push_back (diagnostic);
+		return;
+	}
+	for (const Parser::FunctionBody& function_body: parser.get_function_bodies()) {
+		Body body;
+		body.function = function_body.function;
+		body.start = function_body.cursor.get_pointer() - source;
+		body.end = function_body.text.get_data() + function_body.text.get_length() - source;
+		body.line = function_body.cursor.get_line ();
+		body.source = nullptr;
+		body.pool = nullptr;
+		bodies.push_back (body);
+	}
+	for (Body& body: bodies) parse_body (body, source + body.start);
+}
+
+void Document::parse_body (Body& body, const char* source) {
+	body.diagnostics.clear ();
+	delete body.pool;
+	body.pool = new Pool ();
+	Pool::Scope scope (body.pool);
+	body.function->reset ();
+	try {
+		Parser::parse_function_body (program, body.function, Cursor(source, body.line));
+	}
+	catch (const Diagnostic& diagnostic) {
+		body.diagnostics.push_back (diagnostic);
+	}
+}
+
+// finds the body that contains the range without its braces
+Document::Body* Document::get_body (size_t offset, size_t length) {
+	auto i = std::upper_bound (bodies.begin(), bodies.end(), offset, [] (size_t offset, const Body& body) {
+		return offset < body.start;
+	});
+	if (i == bodies.begin()) return nullptr;
+	--i;
+	if (offset > i->start && offset + length < i->end) return &*i;
+	return nullptr;
+}
+
+void Document::edit (size_t offset, size_t length, const std::string& replacement) {
+	const int lines = std::count (replacement.begin(), replacement.end(), '\n') - std::count (text.begin() + offset, text.begin() + offset + length, '\n');
+	const long delta = (long)replacement.size() - (long)length;
+	Body* body = program ? get_body (offset, length) : nullptr;
+	text.replace (offset, length, replacement);
+	if (!body) {
+		parse ();
+		return;
+	}
+	
+	char* body_source = strndup (text.c_str() + body->start, body->end + delta - body->start);
+	// the edit must not change where the body ends
+	Cursor cursor (body_source);
+	cursor.skip_block ();
+	if (cursor.get_pointer() != body_source + body->end + delta - body->start) {
+		free (body_source);
+		parse ();
+		return;
+	}
+	body->end += delta;
+	for (Body* next = body + 1; next != bodies.data() + bodies.size(); ++next) {
+		next->start += delta;
+		next->end += delta;
+		next->line += lines;
+		// the columns do not change, they count from the line or from the '{' before it
+		for (Diagnostic& diagnostic: next->diagnostics) diagnostic.line += lines;
+	}
+	free (body->source);
+	body->source = body_source;
+	parse_body (*body, body_source);
+}
+
+std::vector<Diagnostic> Document::get_diagnostics () const {
+	std::vector<Diagnostic> result (diagnostics);
+	for (const Body& body: bodies) {
+		result.insert (result.end(), body.diagnostics.begin(), body.diagnostics.end());
+	}
+	return result;
+}
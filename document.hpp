@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "parser.hpp"
+#include <string>
+
+// A source file that stays parsed while it is edited, for editor integrations.
+// An edit inside a function body only parses that body again, everything else
+// is reused. Other edits parse the whole document again.
+class Document {
+	struct Body {
+		Function* function;
+		// the offsets of '{' and after '}' and the line of '{'
+		size_t start;
+		size_t end;
+		int line;
+		// the copy of the source the body was last parsed from, if it was edited
+		char* source;
+		// the nodes of the body, which are freed when it is parsed again
+		Pool* pool;
+		std::vector<Diagnostic> diagnostics;
+	};
+	std::string text;
+	char* source;
+	std::vector<Interface*> interfaces;
+	// the declarations, the bodies have pools of their own
+	Pool* pool;
+	Program* program;
+	std::vector<Diagnostic> diagnostics;
+	std::vector<Body> bodies;
+	void clear ();
+	void parse ();
+	void parse_body (Body& body, const char* source);
+	Body* get_body (size_t offset, size_t length);
+public:
+	Document (const std::string& text, const std::vector<Interface*>& interfaces = std::vector<Interface*>());
+	~Document ();
+	// replaces length characters at offset
+	void edit (size_t offset, size_t length, const std::string& replacement);
+	const std::string& get_text () const {
+		return text;
+	}
+	// the program stays valid until the next edit, it is null if a declaration has an error
+	Program* get_program () const {
+		return program;
+	}
+	std::vector<Diagnostic> get_diagnostics () const;
+};
@@ -0,0 +1,542 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "escape.hpp"
+#include <algorithm>
+#include <set>
+
+using namespace ast;
+
+namespace {
+
+const Type* get_innermost_element_type (const Type* type) {
+	while (const ArrayType* array_type = type->get_array()) type = array_type->get_element_type ();
+	return type;
+}
+
+// the elements of arrays count as attributes
+void add_attribute_classes (const Class* _class, std::set<const Class*>& classes) {
+	for (Variable* attribute: _class->get_attributes()) {
+		const Class* attribute_class = get_innermost_element_type(attribute->get_type())->get_class ();
+		if (attribute_class && classes.insert(attribute_class).second) add_attribute_classes (attribute_class, classes);
+	}
+}
+
+// the classes of the elements of the arrays that are reachable from a value of the type
+void add_array_classes (const Type* type, std::set<const Class*>& classes) {
+	const Class* element_class = get_innermost_element_type(type)->get_class ();
+	if (element_class && type->get_array()) classes.insert (element_class);
+	if (!element_class) return;
+	std::set<const Class*> attribute_classes;
+	attribute_classes.insert (element_class);
+	add_attribute_classes (element_class, attribute_classes);
+	for (const Class* _class: attribute_classes) {
+		for (Variable* attribute: _class->get_attributes()) {
+			const Class* attribute_class = get_innermost_element_type(attribute->get_type())->get_class ();
+			if (attribute_class && attribute->get_type()->get_array()) classes.insert (attribute_class);
+		}
+	}
+}
+
+// whether a callee can store a reference in a value of the type
+bool holds_references (const Type* type) {
+	if (const ArrayType* array_type = type->get_array()) {
+		const Type* element_type = array_type->get_element_type ();
+		return element_type->get_class() || element_type->get_array();
+	}
+	if (const Class* _class = type->get_class()) {
+		for (Variable* attribute: _class->get_attributes()) {
+			if (attribute->get_type()->get_class() || attribute->get_type()->get_array()) return true;
+		}
+	}
+	return false;
+}
+
+// whether the objects reachable from an instance of _class can include an object
+// that is reachable from an instance of other_class, including that instance itself
+bool may_contain (const Class* _class, const Class* other_class) {
+	std::set<const Class*> classes;
+	add_attribute_classes (_class, classes);
+	if (classes.count(other_class)) return true;
+	std::set<const Class*> other_classes;
+	add_attribute_classes (other_class, other_classes);
+	for (const Class* c: other_classes) {
+		if (classes.count(c)) return true;
+	}
+	return false;
+}
+
+}
+
+int Variable::analyze (EscapeAnalysis& analysis) {
+	if (!analysis.is_tracked(type)) return -1;
+	return analysis.get_variable (this);
+}
+
+int Assignment::analyze (EscapeAnalysis& analysis) {
+	int destination = left->analyze (analysis);
+	int source = right->analyze (analysis);
+	if (destination >= 0 && source >= 0) {
+		analysis.unite (destination, source);
+		analysis.store (destination, source);
+	}
+	return source;
+}
+
+int BinaryExpression::analyze (EscapeAnalysis& analysis) {
+	left->analyze (analysis);
+	right->analyze (analysis);
+	return -1;
+}
+
+int And::analyze (EscapeAnalysis& analysis) {
+	left->analyze (analysis);
+	right->analyze (analysis);
+	return -1;
+}
+
+int Or::analyze (EscapeAnalysis& analysis) {
+	left->analyze (analysis);
+	right->analyze (analysis);
+	return -1;
+}
+
+int Call::analyze (EscapeAnalysis& analysis) {
+	std::vector<int> sets;
+	for (Expression* argument: arguments) {
+		const int set = argument->analyze (analysis);
+		if (set >= 0) analysis.expose (set);
+		sets.push_back (set);
+	}
+	const Class* result_class = return_type->get_class ();
+	int result = -1;
+	if (result_class) {
+		// the slot for the result
+		result = analysis.enter_instance (this);
+		analysis.leave_instance ();
+		analysis.expose (result);
+	}
+	else if (return_type->get_array()) {
+		result = analysis.create_array ();
+	}
+	// the callee allocates from the enclosing region too
+	for (int i = 0; i < arguments.size(); ++i) {
+		if (sets[i] < 0 || !holds_references(arguments[i]->get_type())) continue;
+		analysis.store (sets[i], -1);
+		if (result >= 0) analysis.return_reachable (result, sets[i]);
+	}
+	// the callee can store instances in the arrays it reaches through the arguments or the result
+	std::set<const Class*> array_classes;
+	for (Expression* argument: arguments) add_array_classes (argument->get_type(), array_classes);
+	add_array_classes (return_type, array_classes);
+	for (int i = 0; i < arguments.size(); ++i) {
+		const Class* argument_class = arguments[i]->get_type()->get_class ();
+		if (!argument_class) continue;
+		for (const Class* array_class: array_classes) {
+			if (array_class == argument_class || may_contain(array_class, argument_class))
+				analysis.unite (analysis.get_array_elements(), sets[i]);
+		}
+		// the argument or one of its attributes can be returned
+		if (result_class && (result_class == argument_class || may_contain(result_class, argument_class) || may_contain(argument_class, result_class)))
+			analysis.unite (result, sets[i]);
+		// or stored in the attributes of another argument
+		for (int j = 0; j < arguments.size(); ++j) {
+			const Class* other_class = arguments[j]->get_type()->get_class ();
+			if (j != i && other_class && may_contain(other_class, argument_class))
+				analysis.unite (analysis.get_contents(sets[j]), sets[i]);
+		}
+	}
+	return result;
+}
+
+int Instantiation::analyze (EscapeAnalysis& analysis) {
+	int set = analysis.enter_instance (this);
+	for (Expression* value: attribute_values) {
+		int value_set = value->analyze (analysis);
+		if (value_set >= 0) analysis.unite (analysis.get_contents(set), value_set);
+	}
+	analysis.leave_instance ();
+	return set;
+}
+
+int AttributeAccess::analyze (EscapeAnalysis& analysis) {
+	int set = expression->analyze (analysis);
+	if (!analysis.is_tracked(get_type())) return -1;
+	return analysis.get_contents (set);
+}
+
+// the elements of all arrays are in one set whose objects are shared like those of the caller,
+// unless the regions are checked
+int ArrayCreation::analyze (EscapeAnalysis& analysis) {
+	length->analyze (analysis);
+	const int array = analysis.create_array ();
+	const int set = element->analyze (analysis);
+	if (set >= 0) analysis.unite (analysis.get_elements(array), set);
+	return array;
+}
+
+int ArrayLiteral::analyze (EscapeAnalysis& analysis) {
+	const int array = analysis.create_array ();
+	for (Expression* element: elements) {
+		const int set = element->analyze (analysis);
+		if (set >= 0) analysis.unite (analysis.get_elements(array), set);
+	}
+	return array;
+}
+
+int Index::analyze (EscapeAnalysis& analysis) {
+	const int array = this->array->analyze (analysis);
+	index->analyze (analysis);
+	if (!analysis.is_tracked(get_type())) return -1;
+	return analysis.get_elements (array);
+}
+
+int ColumnAccess::analyze (EscapeAnalysis& analysis) {
+	int set = element->analyze (analysis);
+	if (!analysis.is_tracked(get_type())) return -1;
+	return analysis.get_contents (set);
+}
+
+int ArrayLength::analyze (EscapeAnalysis& analysis) {
+	array->analyze (analysis);
+	return -1;
+}
+
+// vectors only contain Int and Bool lanes
+int VectorCreation::analyze (EscapeAnalysis& analysis) {
+	for (Expression* lane: lanes) lane->analyze (analysis);
+	return -1;
+}
+
+int Lane::analyze (EscapeAnalysis& analysis) {
+	vector->analyze (analysis);
+	index->analyze (analysis);
+	return -1;
+}
+
+int Reduction::analyze (EscapeAnalysis& analysis) {
+	vector->analyze (analysis);
+	return -1;
+}
+
+int Shuffle::analyze (EscapeAnalysis& analysis) {
+	left->analyze (analysis);
+	if (right) right->analyze (analysis);
+	return -1;
+}
+
+int Select::analyze (EscapeAnalysis& analysis) {
+	mask->analyze (analysis);
+	left->analyze (analysis);
+	right->analyze (analysis);
+	return -1;
+}
+
+void ExpressionNode::analyze (EscapeAnalysis& analysis) {
+	expression->analyze (analysis);
+}
+
+void Return::analyze (EscapeAnalysis& analysis) {
+	if (!expression) return;
+	int set = expression->analyze (analysis);
+	if (set >= 0) analysis.escape (set);
+}
+
+void If::analyze (EscapeAnalysis& analysis) {
+	condition->analyze (analysis);
+	if_block->analyze (analysis);
+}
+
+void While::analyze (EscapeAnalysis& analysis) {
+	analysis.enter_loop (this);
+	condition->analyze (analysis);
+	block->analyze (analysis);
+	analysis.leave_loop ();
+}
+
+void For::analyze (EscapeAnalysis& analysis) {
+	if (start) start->analyze (analysis);
+	const int set = expression->analyze (analysis);
+	analysis.enter_loop (this);
+	if (array && analysis.is_tracked(variable->get_type())) analysis.unite (analysis.get_variable(variable), analysis.get_elements(set));
+	block->analyze (analysis);
+	analysis.leave_loop ();
+}
+
+void Region::analyze (EscapeAnalysis& analysis) {
+	analysis.enter_region (this);
+	block->analyze (analysis);
+	analysis.leave_region ();
+}
+
+void Block::analyze (EscapeAnalysis& analysis) {
+	for (Node* node: nodes) {
+		analysis.set_node (node);
+		node->analyze (analysis);
+	}
+}
+
+void Function::analyze (EscapeAnalysis& analysis) {
+	// the objects of the caller
+	for (Variable* argument: arguments) {
+		if (analysis.is_tracked(argument->get_type())) analysis.unite (analysis.get_variable(argument), analysis.create_set(true));
+	}
+	block->analyze (analysis);
+}
+
+// EscapeAnalysis
+
+EscapeAnalysis::EscapeAnalysis (Function* function, bool check): check(check), node(nullptr), region_error(nullptr), region_message(nullptr) {
+	escaped = create_set ();
+	array_elements = get_contents (create_set(true));
+	function->analyze (*this);
+	if (check) check_regions ();
+	else solve ();
+}
+
+int EscapeAnalysis::create_set (bool external) {
+	parents.push_back (parents.size());
+	contents.push_back (-1);
+	this->external.push_back (external);
+	exposed.push_back (false);
+	return parents.size() - 1;
+}
+
+int EscapeAnalysis::find (int set) {
+	while (parents[set] != set) set = parents[set] = parents[parents[set]];
+	return set;
+}
+
+void EscapeAnalysis::unite (int set1, int set2) {
+	set1 = find (set1);
+	set2 = find (set2);
+	if (set1 == set2) return;
+	parents[set2] = set1;
+	external[set1] = external[set1] || external[set2];
+	exposed[set1] = exposed[set1] || exposed[set2];
+	const int contents1 = contents[set1];
+	const int contents2 = contents[set2];
+	if (contents1 < 0) contents[set1] = contents2;
+	else if (contents2 >= 0) unite (contents1, contents2);
+}
+
+int EscapeAnalysis::get_contents (int set) {
+	set = find (set);
+	if (contents[set] < 0) {
+		const int attributes = create_set ();
+		contents[set] = attributes;
+	}
+	return contents[set];
+}
+
+void EscapeAnalysis::escape (int set) {
+	unite (escaped, set);
+}
+
+void EscapeAnalysis::expose (int set) {
+	exposed[find(set)] = true;
+}
+
+int EscapeAnalysis::get_variable (const Variable* variable) {
+	auto i = variables.find (variable);
+	if (i != variables.end()) return i->second;
+	const int set = create_set ();
+	variables[variable] = set;
+	holders.push_back (Holder {set, loops.empty() ? nullptr : loops.back(), regions});
+	return set;
+}
+
+void EscapeAnalysis::enter_loop (const Node* loop) {
+	parent_loops[loop] = loops.empty() ? nullptr : loops.back();
+	loops.push_back (loop);
+}
+
+void EscapeAnalysis::leave_loop () {
+	loops.pop_back ();
+}
+
+int EscapeAnalysis::enter_instance (const Expression* expression) {
+	path.push_back (expression);
+	const int set = create_set ();
+	instance_indices[path] = instances.size ();
+	instances.push_back (Instance {set, loops.empty() ? nullptr : loops.back(), STACK});
+	if (check) objects.push_back (Object {set, regions});
+	return set;
+}
+
+void EscapeAnalysis::leave_instance () {
+	path.pop_back ();
+}
+
+int EscapeAnalysis::create_array () {
+	if (!check) return -1;
+	const int set = create_set ();
+	objects.push_back (Object {set, regions});
+	return set;
+}
+
+int EscapeAnalysis::get_elements (int array) {
+	return array >= 0 ? get_contents (array) : array_elements;
+}
+
+void EscapeAnalysis::enter_region (const Node* region) {
+	regions.push_back (region);
+}
+
+void EscapeAnalysis::leave_region () {
+	regions.pop_back ();
+}
+
+void EscapeAnalysis::return_reachable (int result, int set) {
+	if (!check) return;
+	unite (set, get_contents(set));
+	unite (result, set);
+}
+
+void EscapeAnalysis::store (int destination, int source) {
+	if (check && !regions.empty()) stores.push_back (Store {destination, source, regions, node});
+}
+
+bool EscapeAnalysis::is_inside (const Node* loop, const Node* outer) const {
+	if (!outer) return true;
+	while (loop) {
+		if (loop == outer) return true;
+		loop = parent_loops.at (loop);
+	}
+	return false;
+}
+
+void EscapeAnalysis::add_reachable (int set, std::vector<bool>& reachable) {
+	for (set = find(set); !reachable[set]; set = find(contents[set])) {
+		reachable[set] = true;
+		if (contents[set] < 0) break;
+	}
+}
+
+void EscapeAnalysis::solve () {
+	// everything reachable from the attributes of external objects
+	std::vector<bool> shared (parents.size());
+	for (int i = 0; i < parents.size(); ++i) {
+		if (find(i) == i && external[i] && contents[i] >= 0) add_reachable (contents[i], shared);
+	}
+	// and from the returned values
+	std::vector<bool> escaping = shared;
+	add_reachable (escaped, escaping);
+	std::map<int, std::vector<Instance*>> instances_by_set;
+	for (Instance& instance: instances) {
+		instances_by_set[find(instance.set)].push_back (&instance);
+	}
+	
+	// an instance that a variable outside of its loop can reference may still be in use
+	// when the instantiation is evaluated again
+	std::vector<bool> carried (instances.size());
+	for (const Holder& holder: holders) {
+		std::vector<int> chain;
+		for (int set = find(holder.set); std::find(chain.begin(), chain.end(), set) == chain.end(); set = find(contents[set])) {
+			chain.push_back (set);
+			if (contents[set] < 0) break;
+		}
+		for (int set: chain) {
+			auto i = instances_by_set.find (set);
+			if (i == instances_by_set.end()) continue;
+			for (Instance* instance: i->second) {
+				if (!is_inside(holder.loop, instance->loop)) carried[instance - instances.data()] = true;
+			}
+		}
+	}
+	
+	// sets that are the attributes of other sets hold addresses
+	std::vector<bool> stored (parents.size());
+	for (int i = 0; i < parents.size(); ++i) {
+		if (find(i) == i && contents[i] >= 0) stored[find(contents[i])] = true;
+	}
+	for (auto& entry: instances_by_set) {
+		const int set = entry.first;
+		const bool single = entry.second.size() == 1;
+		for (Instance* instance: entry.second) {
+			if (carried[instance - instances.data()]) instance->allocation = HEAP;
+			else if (!escaping[set]) instance->allocation = single && !external[set] && !exposed[set] && !stored[set] ? REPLACED : STACK;
+			else if (set == find(escaped) && single && !shared[set] && !stored[set]) instance->allocation = RESULT;
+			else instance->allocation = HEAP;
+		}
+	}
+	for (auto& entry: variables) {
+		auto i = instances_by_set.find (find(entry.second));
+		if (i != instances_by_set.end() && i->second[0]->allocation == REPLACED) replaced_variables[entry.first] = i->second[0] - instances.data();
+	}
+}
+
+int EscapeAnalysis::get_instance (const std::vector<const Expression*>& path) const {
+	auto i = instance_indices.find (path);
+	return i != instance_indices.end() ? i->second : -1;
+}
+
+int EscapeAnalysis::get_replaced_instance (const Variable* variable) const {
+	auto i = replaced_variables.find (variable);
+	return i != replaced_variables.end() ? i->second : -1;
+}
+
+// whether the store can let an object allocated inside the region outlive it
+bool EscapeAnalysis::escapes (const Store& store, const Node* region) {
+	auto is_inside = [region](const std::vector<const Node*>& regions) {
+		return std::find(regions.begin(), regions.end(), region) != regions.end();
+	};
+	// the objects allocated inside the region, including those of callees in the arguments
+	std::vector<bool> inside (parents.size());
+	for (const Store& call: stores) {
+		if (call.source < 0 && is_inside(call.regions)) add_reachable (call.destination, inside);
+	}
+	for (const Object& object: objects) {
+		if (is_inside(object.regions)) inside[find(object.set)] = true;
+	}
+	std::vector<bool> source (parents.size());
+	if (store.source >= 0) add_reachable (store.source, source);
+	bool allocated_inside = store.source < 0;
+	for (int i = 0; i < parents.size(); ++i) {
+		if (source[i] && inside[i]) allocated_inside = true;
+	}
+	if (!allocated_inside) return false;
+	// a variable from outside of the region outlives it
+	for (const Holder& holder: holders) {
+		if (holder.set == store.destination) return !is_inside(holder.regions);
+	}
+	// and so does everything reachable from it or from objects allocated before the region
+	std::vector<bool> outside (parents.size());
+	add_reachable (escaped, outside);
+	for (int i = 0; i < parents.size(); ++i) {
+		if (find(i) == i && external[i]) add_reachable (i, outside);
+	}
+	for (const Holder& holder: holders) {
+		if (!is_inside(holder.regions)) add_reachable (holder.set, outside);
+	}
+	for (const Object& object: objects) {
+		if (!is_inside(object.regions)) add_reachable (object.set, outside);
+	}
+	return outside[find(store.destination)];
+}
+
+void EscapeAnalysis::check_regions () {
+	for (const Store& store: stores) {
+		for (const Node* region: store.regions) {
+			if (escapes(store, region)) {
+				region_error = store.node;
+				region_message = store.source < 0 ? "objects from outside of a region that can reference others cannot be passed to calls inside of it" : "instances and arrays allocated inside a region cannot be stored outside of it";
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,157 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "ast.hpp"
+#include <map>
+#include <vector>
+
+// Finds the instances that may outlive the function or the loop iteration that
+// created them. These are allocated on the heap, all others get a stack slot in
+// the entry block that is reused every time their instantiation is evaluated.
+// The results of calls are instances as well, their slot is passed to the callee.
+//
+// Values are grouped into sets of objects that may be referenced by the same
+// variable, unified on assignments (Steensgaard). The attributes of the objects
+// in a set form another set, so the sets reachable from a set are all objects
+// reachable from it. Since there are no global variables, a call can only pass
+// an argument to its result or into the objects of another argument, which the
+// types of the arguments and the result limit.
+//
+// A stack instance is replaced by one alloca per attribute if every value in its
+// set is known to reference it, so its address is never needed. An instance that
+// is returned and referenced by nothing else is created in the slot of the caller.
+//
+// The parser uses the analysis to check functions with regions instead. Arrays
+// are objects then, whose elements are their attributes, and everything that is
+// allocated inside a region, including the results of calls, must not be stored
+// in a variable or an object from outside of it. Callees allocate from the region
+// as well, so they must not get objects from outside that can reference others.
+class EscapeAnalysis {
+public:
+	enum Allocation {
+		HEAP,
+		STACK,
+		REPLACED,
+		// in the slot of the caller if it passed one
+		RESULT
+	};
+private:
+	struct Instance {
+		int set;
+		const ast::Node* loop;
+		Allocation allocation;
+	};
+	struct Holder {
+		int set;
+		const ast::Node* loop;
+		std::vector<const ast::Node*> regions;
+	};
+	// an instance or array allocated inside the regions
+	struct Object {
+		int set;
+		std::vector<const ast::Node*> regions;
+	};
+	struct Store {
+		int destination;
+		// -1 for the objects a callee allocates
+		int source;
+		std::vector<const ast::Node*> regions;
+		const ast::Node* node;
+	};
+	std::vector<int> parents;
+	std::vector<int> contents;
+	// the attributes of external objects, like those of the arguments, escape
+	std::vector<bool> external;
+	// the objects are passed to or returned from calls
+	std::vector<bool> exposed;
+	int escaped;
+	int array_elements;
+	std::map<const ast::Variable*, int> variables;
+	std::vector<Holder> holders;
+	std::vector<const ast::Node*> loops;
+	std::map<const ast::Node*, const ast::Node*> parent_loops;
+	std::vector<const ast::Expression*> path;
+	std::map<std::vector<const ast::Expression*>, int> instance_indices;
+	std::vector<Instance> instances;
+	std::map<const ast::Variable*, int> replaced_variables;
+	bool check;
+	std::vector<const ast::Node*> regions;
+	const ast::Node* node;
+	std::vector<Object> objects;
+	std::vector<Store> stores;
+	const ast::Node* region_error;
+	const char* region_message;
+	int find (int set);
+	bool is_inside (const ast::Node* loop, const ast::Node* outer) const;
+	void add_reachable (int set, std::vector<bool>& reachable);
+	void solve ();
+	bool escapes (const Store& store, const ast::Node* region);
+	void check_regions ();
+public:
+	// with check set, only the regions are checked
+	EscapeAnalysis (ast::Function* function, bool check = false);
+	int create_set (bool external = false);
+	void unite (int set1, int set2);
+	int get_contents (int set);
+	void escape (int set);
+	void expose (int set);
+	// the objects stored in arrays, which are shared like those of the caller
+	int get_array_elements () const {
+		return array_elements;
+	}
+	// whether values of the type reference objects, arrays only when checking regions
+	bool is_tracked (const ast::Type* type) const {
+		return type->get_class() || (check && type->get_array());
+	}
+	// the set of a new array or -1 if arrays are not tracked
+	int create_array ();
+	int get_elements (int array);
+	void enter_region (const ast::Node* region);
+	void leave_region ();
+	// the statement that is being analyzed
+	void set_node (const ast::Node* node) {
+		this->node = node;
+	}
+	// the source is stored in the destination
+	void store (int destination, int source);
+	// when checking regions, the result of a call can be any object reachable from the set
+	void return_reachable (int result, int set);
+	// the statement that lets an allocation outlive its region or nullptr
+	const ast::Node* get_region_error () const {
+		return region_error;
+	}
+	const char* get_region_message () const {
+		return region_message;
+	}
+	// the set of the objects the variable references, it is declared in the current loop
+	int get_variable (const ast::Variable* variable);
+	void enter_loop (const ast::Node* loop);
+	void leave_loop ();
+	// instances are identified by the instantiations and calls that are being evaluated, since
+	// the default values of attributes are evaluated again for every instantiation of the class
+	int enter_instance (const ast::Expression* expression);
+	void leave_instance ();
+	// the index of the instance or -1 if it is unknown
+	int get_instance (const std::vector<const ast::Expression*>& path) const;
+	Allocation get_allocation (int instance) const {
+		return instance >= 0 ? instances[instance].allocation : HEAP;
+	}
+	// the slot of the replaced instance the variable always references or -1
+	int get_replaced_instance (const ast::Variable* variable) const;
+};
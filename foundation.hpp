@@ -17,6 +17,7 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #pragma once
 
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -77,6 +78,12 @@ class Substring {
 public:
 	Substring (const char* start, int length): start(start), length(length) {}
 	Substring (const char* string): start(string), length(strlen(string)) {}
+	const char* get_data () const {
+		return start;
+	}
+	int get_length () const {
+		return length;
+	}
 	void write (FILE* file) const {
 		fwrite (start, 1, length, file);
 	}
@@ -91,6 +98,34 @@ public:
 	}
 };
 
+// 64 bit FNV-1a
+class Hash {
+	uint64_t value;
+public:
+	Hash (): value(14695981039346656037ULL) {}
+	void add (const void* data, size_t length) {
+		const unsigned char* bytes = (const unsigned char*) data;
+		for (size_t i = 0; i < length; ++i) {
+			value ^= bytes[i];
+			value *= 1099511628211ULL;
+		}
+	}
+	void add (const char* s) {
+		// include the terminator so that consecutive strings cannot collide
+		add (s, strlen(s) + 1);
+	}
+	void add (uint64_t n) {
+		add (&n, sizeof(n));
+	}
+	void add (const Substring& s) {
+		add (s.get_data(), s.get_length());
+		add ((uint64_t)s.get_length());
+	}
+	uint64_t get () const {
+		return value;
+	}
+};
+
 class File;
 class Printable {
 public:
@@ -0,0 +1,415 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "interface.hpp"
+#include "parser.hpp"
+#include "writer.hpp"
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// All offsets are relative to the start of the file and all words are 32 bit.
+// header:    "REAI", version, table size, 0, 64 bit hash of the rest of the file
+// table:     offsets of the symbols, 0 for empty slots, indexed by the hash of the name
+// symbol:    name, class or 0, function count, functions...
+// class:     flags, attribute count, (name, type, default kind, default value)...
+// Default kinds: 1 for literals, whose value follows, 2 for other expressions,
+//            whose source follows as a string that importers parse
+// Flags:     1 for packed classes, 2 for soa classes
+// function:  name, mangled name, return type, argument count, argument types...
+// string:    length, characters, terminator, padding
+// Types are the offsets of their names.
+
+#define MAGIC "REAI"
+#define VERSION 4
+#define HEADER_SIZE 24
+
+namespace {
+
+uint64_t get_name_hash (const Substring& name) {
+	Hash hash;
+	hash.add (name);
+	return hash.get ();
+}
+
+class InterfaceWriter {
+	std::string buffer;
+	std::map<std::string, uint32_t> strings;
+public:
+	uint32_t get_position () const {
+		return buffer.size ();
+	}
+	void write (const void* data, size_t size) {
+		buffer.append ((const char*)data, size);
+	}
+	void write_word (uint32_t word) {
+		write (&word, sizeof(word));
+	}
+	uint32_t get_word (uint32_t offset) const {
+		uint32_t word;
+		memcpy (&word, &buffer[offset], sizeof(word));
+		return word;
+	}
+	void set_word (uint32_t offset, uint32_t word) {
+		memcpy (&buffer[offset], &word, sizeof(word));
+	}
+	uint32_t write_string (const Substring& s) {
+		std::string string (s.get_data(), s.get_length());
+		auto i = strings.find (string);
+		if (i != strings.end()) return i->second;
+		uint32_t offset = get_position ();
+		write_word (string.size());
+		buffer.append (string);
+		do buffer.push_back ('\0'); while (buffer.size() % 4 != 0);
+		strings[string] = offset;
+		return offset;
+	}
+	uint32_t write_class (ast::Class* _class) {
+		std::vector<uint32_t> words;
+		for (int i = 0; i < _class->get_attributes().size(); ++i) {
+			ast::Variable* attribute = _class->get_attributes()[i];
+			int value = 0;
+			const bool constant = _class->get_default_values()[i]->get_constant_value (value);
+			words.push_back (write_string(attribute->get_name()));
+			words.push_back (write_string(attribute->get_type()->get_name()));
+			words.push_back (constant ? 1 : 2);
+			words.push_back (constant ? value : write_string(_class->get_default_sources()[i]));
+		}
+		uint32_t offset = get_position ();
+		write_word ((_class->packed ? 1 : 0) | (_class->soa ? 2 : 0));
+		write_word (_class->get_attributes().size());
+		for (uint32_t word: words) write_word (word);
+		return offset;
+	}
+	uint32_t write_function (ast::FunctionDeclaration* function) {
+		std::string mangled_name = writer::get_mangled_name (function);
+		std::vector<uint32_t> words;
+		words.push_back (write_string(function->get_name()));
+		words.push_back (write_string(Substring(mangled_name.c_str())));
+		words.push_back (write_string(function->get_return_type()->get_name()));
+		std::vector<uint32_t> arguments;
+		for (int i = 0; const ast::Type* argument = function->get_argument(i); ++i) {
+			arguments.push_back (write_string(argument->get_name()));
+		}
+		words.push_back (arguments.size());
+		words.insert (words.end(), arguments.begin(), arguments.end());
+		uint32_t offset = get_position ();
+		for (uint32_t word: words) write_word (word);
+		return offset;
+	}
+	bool write_file (const char* path) {
+		Hash hash;
+		hash.add (buffer.data() + HEADER_SIZE, buffer.size() - HEADER_SIZE);
+		uint64_t value = hash.get ();
+		memcpy (&buffer[16], &value, sizeof(value));
+		FILE* file = fopen (path, "wb");
+		if (!file) return false;
+		fwrite (buffer.data(), 1, buffer.size(), file);
+		return fclose (file) == 0;
+	}
+};
+
+}
+
+std::recursive_mutex Interface::mutex;
+
+Interface::Interface (const char* data, size_t size): data(data), size(size) {
+	symbols.resize (get_word(8), Symbol {false, nullptr, {}});
+}
+
+uint32_t Interface::get_word (uint32_t offset) const {
+	if (offset + 4 > size) {
+		fprintf (stderr, "error: corrupt interface\n");
+		exit (EXIT_FAILURE);
+	}
+	uint32_t word;
+	memcpy (&word, data + offset, sizeof(word));
+	return word;
+}
+
+Substring Interface::get_string (uint32_t offset) const {
+	uint32_t length = get_word (offset);
+	if (offset + 4 + length > size) {
+		fprintf (stderr, "error: corrupt interface\n");
+		exit (EXIT_FAILURE);
+	}
+	return Substring (data + offset + 4, length);
+}
+
+const ast::Type* Interface::get_type (uint32_t offset, ast::Program* program) const {
+	return get_type (get_string(offset), program);
+}
+
+const ast::Type* Interface::get_type (const Substring& name, ast::Program* program) const {
+	if (name.get_length() > 2 && name.get_data()[0] == '[') {
+		const ast::Type* element_type = get_type (Substring(name.get_data() + 1, name.get_length() - 2), program);
+		return ast::ArrayType::get (element_type);
+	}
+	if (name == ast::Type::INT.get_name()) return &ast::Type::INT;
+	if (name == ast::Type::BOOL.get_name()) return &ast::Type::BOOL;
+	if (name == ast::Type::VOID.get_name()) return &ast::Type::VOID;
+	if (const ast::VectorType* vector_type = ast::VectorType::get(name)) return vector_type;
+	const ast::Type* type = program->get_class (name);
+	if (!type) {
+		File (stderr).print ("error: interface refers to unknown class '%'\n", name);
+		exit (EXIT_FAILURE);
+	}
+	return type;
+}
+
+int Interface::find_slot (const Substring& name) const {
+	const uint32_t mask = symbols.size() - 1;
+	for (uint32_t slot = get_name_hash(name) & mask;; slot = (slot + 1) & mask) {
+		uint32_t offset = get_word (HEADER_SIZE + slot * 4);
+		if (offset == 0) return -1;
+		if (get_string(get_word(offset)) == name) return slot;
+	}
+}
+
+Interface::Symbol* Interface::get_symbol (const Substring& name, ast::Program* program) {
+	const uint32_t mask = symbols.size() - 1;
+	for (uint32_t slot = get_name_hash(name) & mask;; slot = (slot + 1) & mask) {
+		uint32_t offset = get_word (HEADER_SIZE + slot * 4);
+		if (offset == 0) return nullptr;
+		if (!(get_string(get_word(offset)) == name)) continue;
+		
+		std::lock_guard<std::recursive_mutex> lock (mutex);
+		Symbol& symbol = symbols[slot];
+		if (symbol.loaded) return &symbol;
+		symbol.loaded = true;
+		// the symbols stay loaded with the interface, even for programs that are freed
+		ast::Pool::Scope scope (nullptr);
+		if (uint32_t class_offset = get_word(offset + 4)) {
+			symbol._class = new ast::Class (get_string(get_word(offset)));
+			symbol._class->packed = get_word (class_offset) & 1;
+			symbol._class->soa = (get_word (class_offset) & 2) != 0;
+			const uint32_t count = get_word (class_offset + 4);
+			for (uint32_t i = 0; i < count; ++i) {
+				const uint32_t attribute = class_offset + 8 + i * 16;
+				const ast::Type* type = get_type (get_word(attribute + 4), program);
+				ast::Expression* value = nullptr;
+				const uint32_t kind = get_word (attribute + 8);
+				if (kind == 1) {
+					if (type == &ast::Type::BOOL) value = new ast::BooleanLiteral (get_word(attribute + 12));
+					else value = new ast::Number (get_word(attribute + 12));
+				}
+				else if (kind == 2) {
+					// parsed in the importing program, like the attribute in the library
+					const Substring source = get_string (get_word(attribute + 12));
+					value = Parser::parse_default_value (program, symbol._class, source.get_data());
+					if (value->get_type() != type) {
+						File (stderr).print ("error: the default value of attribute '%' of class '%' has a different type in this program\n", get_string(get_word(attribute)), symbol._class->get_name());
+						exit (EXIT_FAILURE);
+					}
+				}
+				symbol._class->add_attribute (get_string(get_word(attribute)), type, value);
+			}
+		}
+		const uint32_t count = get_word (offset + 8);
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t function_offset = get_word (offset + 12 + i * 4);
+			ast::FunctionDeclaration* function = new ast::FunctionDeclaration (get_string(get_word(function_offset)));
+			function->set_return_type (get_type(get_word(function_offset + 8), program));
+			const uint32_t argument_count = get_word (function_offset + 12);
+			for (uint32_t j = 0; j < argument_count; ++j) {
+				function->add_argument (new ast::Variable ("", get_type(get_word(function_offset + 16 + j * 4), program)));
+			}
+			symbol.functions.push_back (function);
+		}
+		return &symbol;
+	}
+}
+
+Interface* Interface::load (const char* path) {
+	int fd = open (path, O_RDONLY);
+	if (fd < 0) {
+		fprintf (stderr, "error: cannot open file '%s'\n", path);
+		return nullptr;
+	}
+	struct stat s;
+	if (fstat (fd, &s) != 0) s.st_size = 0;
+	// interfaces stay loaded, so a compile server maps every file only once
+	static std::map<std::string, Interface*> interfaces;
+	std::string identity = std::to_string(s.st_dev) + ":" + std::to_string(s.st_ino) + ":" + std::to_string(s.st_mtime) + ":" + std::to_string(s.st_size);
+	auto i = interfaces.find (identity);
+	if (i != interfaces.end()) {
+		close (fd);
+		return i->second;
+	}
+	void* data = MAP_FAILED;
+	if (s.st_size >= HEADER_SIZE) {
+		data = mmap (nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close (fd);
+	if (data == MAP_FAILED) {
+		fprintf (stderr, "error: cannot read interface '%s'\n", path);
+		return nullptr;
+	}
+	const char* bytes = (const char*) data;
+	uint32_t version, table_size;
+	memcpy (&version, bytes + 4, sizeof(version));
+	memcpy (&table_size, bytes + 8, sizeof(table_size));
+	if (memcmp (bytes, MAGIC, 4) != 0 || version != VERSION || table_size == 0 || (table_size & (table_size - 1)) != 0 || HEADER_SIZE + (size_t)table_size * 4 > s.st_size) {
+		fprintf (stderr, "error: '%s' is not a valid interface\n", path);
+		munmap (data, s.st_size);
+		return nullptr;
+	}
+	return interfaces[identity] = new Interface (bytes, s.st_size);
+}
+
+// like get_type, the first interface with a symbol of the name is used
+bool Interface::is_resolvable (const Substring& type, const std::vector<Interface*>& interfaces, Visited& visited) {
+	if (type.get_length() > 2 && type.get_data()[0] == '[') return is_resolvable (Substring(type.get_data() + 1, type.get_length() - 2), interfaces, visited);
+	if (type == ast::Type::INT.get_name() || type == ast::Type::BOOL.get_name() || type == ast::Type::VOID.get_name() || ast::VectorType::get(type)) return true;
+	for (Interface* interface: interfaces) {
+		const int slot = interface->find_slot (type);
+		if (slot < 0) continue;
+		if (!interface->is_independent (slot, interfaces, visited)) return false;
+		if (interface->get_word(interface->get_word(HEADER_SIZE + slot * 4) + 4)) return true;
+	}
+	return false;
+}
+
+// default values that are expressions are parsed in the importing program
+bool Interface::is_independent (int slot, const std::vector<Interface*>& interfaces, Visited& visited) const {
+	if (!visited.insert(std::make_pair(this, slot)).second) return true;
+	const uint32_t offset = get_word (HEADER_SIZE + slot * 4);
+	if (uint32_t class_offset = get_word(offset + 4)) {
+		const uint32_t count = get_word (class_offset + 4);
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t attribute = class_offset + 8 + i * 16;
+			if (get_word(attribute + 8) == 2 || !is_resolvable(get_string(get_word(attribute + 4)), interfaces, visited)) return false;
+		}
+	}
+	const uint32_t count = get_word (offset + 8);
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint32_t function_offset = get_word (offset + 12 + i * 4);
+		if (!is_resolvable(get_string(get_word(function_offset + 8)), interfaces, visited)) return false;
+		const uint32_t argument_count = get_word (function_offset + 12);
+		for (uint32_t j = 0; j < argument_count; ++j) {
+			if (!is_resolvable(get_string(get_word(function_offset + 16 + j * 4)), interfaces, visited)) return false;
+		}
+	}
+	return true;
+}
+
+void Interface::materialize (const std::vector<Interface*>& interfaces) {
+	// the program that resolves the types stays loaded like the symbols
+	ast::Pool::Scope scope (nullptr);
+	ast::Program* program = new ast::Program ();
+	for (Interface* interface: interfaces) program->add_interface (interface);
+	for (Interface* interface: interfaces) {
+		for (int slot = 0; slot < interface->symbols.size(); ++slot) {
+			const uint32_t offset = interface->get_word (HEADER_SIZE + slot * 4);
+			Visited visited;
+			if (offset != 0 && interface->is_independent (slot, interfaces, visited)) interface->get_symbol (interface->get_string(interface->get_word(offset)), program);
+		}
+	}
+}
+
+bool Interface::write (const char* path, ast::Program* program) {
+	// group the classes and functions by name
+	std::map<Substring, Symbol> symbols;
+	for (ast::Class* _class: program->get_classes()) symbols[_class->get_name()]._class = _class;
+	for (ast::Function* function: program->get_functions()) symbols[function->get_name()].functions.push_back (function);
+	
+	uint32_t table_size = 1;
+	while (table_size < symbols.size() * 2) table_size *= 2;
+	InterfaceWriter writer;
+	writer.write (MAGIC, 4);
+	writer.write_word (VERSION);
+	writer.write_word (table_size);
+	writer.write_word (0);
+	writer.write_word (0);
+	writer.write_word (0);
+	for (uint32_t i = 0; i < table_size; ++i) writer.write_word (0);
+	
+	for (auto& i: symbols) {
+		const Substring& name = i.first;
+		Symbol& symbol = i.second;
+		uint32_t name_offset = writer.write_string (name);
+		uint32_t class_offset = symbol._class ? writer.write_class (symbol._class) : 0;
+		std::vector<uint32_t> function_offsets;
+		for (ast::FunctionDeclaration* function: symbol.functions) function_offsets.push_back (writer.write_function(function));
+		uint32_t offset = writer.get_position ();
+		writer.write_word (name_offset);
+		writer.write_word (class_offset);
+		writer.write_word (function_offsets.size());
+		for (uint32_t function_offset: function_offsets) writer.write_word (function_offset);
+		
+		const uint32_t mask = table_size - 1;
+		uint32_t slot = get_name_hash(name) & mask;
+		while (writer.get_word (HEADER_SIZE + slot * 4) != 0) slot = (slot + 1) & mask;
+		writer.set_word (HEADER_SIZE + slot * 4, offset);
+	}
+	if (!writer.write_file (path)) {
+		fprintf (stderr, "error: cannot write interface '%s'\n", path);
+		return false;
+	}
+	return true;
+}
+
+uint64_t Interface::get_hash () const {
+	uint64_t hash;
+	memcpy (&hash, data + 16, sizeof(hash));
+	return hash;
+}
+
+ast::Class* Interface::get_class (const Substring& name, ast::Program* program) {
+	Symbol* symbol = get_symbol (name, program);
+	return symbol ? symbol->_class : nullptr;
+}
+
+const std::vector<ast::FunctionDeclaration*>* Interface::get_functions (const Substring& name, ast::Program* program) {
+	Symbol* symbol = get_symbol (name, program);
+	if (!symbol || symbol->functions.empty()) return nullptr;
+	return &symbol->functions;
+}
+
+std::vector<ast::Class*> Interface::get_classes () const {
+	std::vector<ast::Class*> result;
+	for (const Symbol& symbol: symbols) {
+		if (symbol._class) result.push_back (symbol._class);
+	}
+	return result;
+}
+
+std::vector<ast::FunctionDeclaration*> Interface::get_function_declarations () const {
+	std::vector<ast::FunctionDeclaration*> result;
+	for (const Symbol& symbol: symbols) {
+		result.insert (result.end(), symbol.functions.begin(), symbol.functions.end());
+	}
+	return result;
+}
+
+// imported symbols are materialized when they are first used
+
+ast::Class* ast::Program::get_imported_class (const Substring& name) {
+	for (Interface* interface: interfaces) {
+		if (Class* _class = interface->get_class (name, this)) return _class;
+	}
+	return nullptr;
+}
+
+const std::vector<ast::FunctionDeclaration*>* ast::Program::get_imported_functions (const Substring& name) {
+	for (Interface* interface: interfaces) {
+		if (const std::vector<FunctionDeclaration*>* functions = interface->get_functions (name, this)) return functions;
+	}
+	return nullptr;
+}
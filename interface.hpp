@@ -0,0 +1,61 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "ast.hpp"
+#include <mutex>
+#include <set>
+
+// A precompiled interface holds the classes and function signatures of a program
+// so that other programs can use them without parsing their source.
+// The file is mapped into memory and its symbols are materialized on first use.
+class Interface {
+	struct Symbol {
+		bool loaded;
+		ast::Class* _class;
+		std::vector<ast::FunctionDeclaration*> functions;
+	};
+	const char* data;
+	size_t size;
+	std::vector<Symbol> symbols;
+	typedef std::set<std::pair<const Interface*, int>> Visited;
+	// materializing a symbol can materialize symbols of other interfaces
+	static std::recursive_mutex mutex;
+	Interface (const char* data, size_t size);
+	uint32_t get_word (uint32_t offset) const;
+	Substring get_string (uint32_t offset) const;
+	const ast::Type* get_type (uint32_t offset, ast::Program* program) const;
+	const ast::Type* get_type (const Substring& name, ast::Program* program) const;
+	// the slot of the symbol or -1
+	int find_slot (const Substring& name) const;
+	Symbol* get_symbol (const Substring& name, ast::Program* program);
+	static bool is_resolvable (const Substring& type, const std::vector<Interface*>& interfaces, Visited& visited);
+	bool is_independent (int slot, const std::vector<Interface*>& interfaces, Visited& visited) const;
+public:
+	static Interface* load (const char* path);
+	static bool write (const char* path, ast::Program* program);
+	uint64_t get_hash () const;
+	// materializes the symbols that are the same in every program that imports these
+	// interfaces, so that a compile server does it once for all requests
+	static void materialize (const std::vector<Interface*>& interfaces);
+	ast::Class* get_class (const Substring& name, ast::Program* program);
+	const std::vector<ast::FunctionDeclaration*>* get_functions (const Substring& name, ast::Program* program);
+	// the symbols that were used so far, in a deterministic order
+	std::vector<ast::Class*> get_classes () const;
+	std::vector<ast::FunctionDeclaration*> get_function_declarations () const;
+};
@@ -0,0 +1,235 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "jit.hpp"
+
+#ifdef REA_JIT
+
+#include "writer.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+
+namespace {
+
+const int MAX_ARGUMENTS = 6;
+
+template <class F> std::string print_to_string (const F& f) {
+	char* buffer;
+	size_t size;
+	FILE* file = open_memstream (&buffer, &size);
+	f (file);
+	fclose (file);
+	std::string result (buffer, size);
+	free (buffer);
+	return result;
+}
+
+std::string get_mangled_name (ast::FunctionDeclaration* function) {
+	return print_to_string ([=] (FILE* file) {
+		File (file).print (function->get_mangled_name());
+	});
+}
+
+bool is_scalar (const ast::Type* type) {
+	return type == &ast::Type::INT || type == &ast::Type::BOOL;
+}
+
+// the interpreter can only call functions with a scalar signature
+bool is_callable (const ast::FunctionDeclaration* function) {
+	for (int i = 0; const ast::Type* argument = function->get_argument(i); ++i) {
+		if (i == MAX_ARGUMENTS || !is_scalar(argument)) return false;
+	}
+	return function->get_return_type() == &ast::Type::VOID || is_scalar (function->get_return_type());
+}
+
+// the runtime functions of stdlib.c
+void* allocate (int64_t size) {
+	return malloc (size);
+}
+
+void* enter_region () {
+	return nullptr;
+}
+
+void leave_region (void* mark) {}
+
+void index_error (int32_t index, int32_t length) {
+	fflush (stdout);
+	fprintf (stderr, "error: index %d is out of bounds for length %d\n", index, length);
+	exit (EXIT_FAILURE);
+}
+
+void length_error (int32_t length) {
+	fflush (stdout);
+	fprintf (stderr, "error: invalid array length %d\n", length);
+	exit (EXIT_FAILURE);
+}
+
+class OrcJit: public vm::Jit {
+	ast::Program* program;
+	const vm::Program& vm_program;
+	std::unique_ptr<llvm::orc::LLJIT> jit;
+	bool initialized;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<vm::Function*> queue;
+	bool done;
+	std::thread thread;
+	bool initialize ();
+	void compile (vm::Function* function);
+	void work ();
+public:
+	OrcJit (ast::Program* program, const vm::Program& vm_program): program(program), vm_program(vm_program), initialized(false), done(false) {
+		thread = std::thread (&OrcJit::work, this);
+	}
+	~OrcJit () {
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			done = true;
+		}
+		condition.notify_one ();
+		thread.join ();
+	}
+	void request (vm::Function* function) override {
+		if (!is_callable(function->declaration)) return;
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			queue.push_back (function);
+		}
+		condition.notify_one ();
+	}
+};
+
+void print_error (llvm::Error error) {
+	llvm::logAllUnhandledErrors (std::move(error), llvm::errs(), "rea: jit: ");
+}
+
+// the whole program is added as one module the first time a function gets hot
+bool OrcJit::initialize () {
+	llvm::InitializeNativeTarget ();
+	llvm::InitializeNativeTargetAsmPrinter ();
+	auto builder = llvm::orc::LLJITBuilder().create ();
+	if (!builder) {
+		print_error (builder.takeError());
+		return false;
+	}
+	jit = std::move (*builder);
+	
+	jit->getIRTransformLayer().setTransform ([] (llvm::orc::ThreadSafeModule module, const llvm::orc::MaterializationResponsibility&) {
+		module.withModuleDo ([] (llvm::Module& module) {
+			llvm::LoopAnalysisManager lam;
+			llvm::FunctionAnalysisManager fam;
+			llvm::CGSCCAnalysisManager cgam;
+			llvm::ModuleAnalysisManager mam;
+			llvm::PassBuilder pass_builder;
+			pass_builder.registerModuleAnalyses (mam);
+			pass_builder.registerCGSCCAnalyses (cgam);
+			pass_builder.registerFunctionAnalyses (fam);
+			pass_builder.registerLoopAnalyses (lam);
+			pass_builder.crossRegisterProxies (lam, fam, cgam, mam);
+			pass_builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2).run (module, mam);
+		});
+		return llvm::Expected<llvm::orc::ThreadSafeModule> (std::move(module));
+	});
+	
+	// builtins resolve to the implementations used by the interpreter
+	llvm::orc::SymbolMap symbols;
+	for (vm::Function* function: vm_program.get_functions()) {
+		if (!function->native) continue;
+		symbols[jit->mangleAndIntern(get_mangled_name(function->declaration))] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(function->address.load()), llvm::JITSymbolFlags::Exported);
+	}
+	// instances that escape are allocated on the heap and, as in the interpreter, never freed
+	symbols[jit->mangleAndIntern("rea.allocate")] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(&allocate), llvm::JITSymbolFlags::Exported);
+	symbols[jit->mangleAndIntern("rea.region.enter")] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(&enter_region), llvm::JITSymbolFlags::Exported);
+	symbols[jit->mangleAndIntern("rea.region.leave")] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(&leave_region), llvm::JITSymbolFlags::Exported);
+	symbols[jit->mangleAndIntern("rea.index_error")] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(&index_error), llvm::JITSymbolFlags::Exported);
+	symbols[jit->mangleAndIntern("rea.length_error")] = llvm::JITEvaluatedSymbol (llvm::pointerToJITTargetAddress(&length_error), llvm::JITSymbolFlags::Exported);
+	if (llvm::Error error = jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(symbols))) {
+		print_error (std::move(error));
+		return false;
+	}
+	
+	std::string ir = print_to_string ([=] (FILE* file) {
+		Writer writer;
+		program->write (writer);
+		writer.write (file);
+	});
+	auto context = std::make_unique<llvm::LLVMContext> ();
+	llvm::SMDiagnostic diagnostic;
+	std::unique_ptr<llvm::Module> module = llvm::parseIR (llvm::MemoryBufferRef(ir, "rea"), diagnostic, *context);
+	if (!module) {
+		diagnostic.print ("rea: jit", llvm::errs());
+		return false;
+	}
+	if (llvm::Error error = jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+		print_error (std::move(error));
+		return false;
+	}
+	return true;
+}
+
+void OrcJit::compile (vm::Function* function) {
+	auto symbol = jit->lookup (get_mangled_name(function->declaration));
+	if (!symbol) {
+		print_error (symbol.takeError());
+		return;
+	}
+	// patch all subsequent calls from the interpreter
+	function->address.store ((void*)symbol->getAddress(), std::memory_order_release);
+}
+
+void OrcJit::work () {
+	bool available = false;
+	while (true) {
+		vm::Function* function;
+		{
+			std::unique_lock<std::mutex> lock (mutex);
+			condition.wait (lock, [this] { return done || !queue.empty(); });
+			if (done) return;
+			function = queue.front ();
+			queue.pop_front ();
+		}
+		if (!initialized) {
+			initialized = true;
+			available = initialize ();
+		}
+		if (available) compile (function);
+	}
+}
+
+}
+
+vm::Jit* vm::Jit::create (ast::Program* program, const Program& vm_program) {
+	return new OrcJit (program, vm_program);
+}
+
+#else
+
+vm::Jit* vm::Jit::create (ast::Program* program, const Program& vm_program) {
+	return nullptr;
+}
+
+#endif
@@ -17,17 +17,240 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #include "parser.hpp"
 #include "writer.hpp"
+#include "cache.hpp"
+#include "interface.hpp"
+#include "jit.hpp"
+#include "build.hpp"
+#include "report.hpp"
+#include "server.hpp"
+#include "profile.hpp"
 
-int main (int argc, char** argv) {
-	if (argc < 2) {
+static int run_program (ast::Program* program, bool tiered) {
+	vm::Program vm_program;
+	{
+		profile::Scope scope ("phase", "bytecode");
+		vm::Compiler compiler (vm_program, program);
+		program->compile (compiler);
+	}
+	vm::Function* main_function = vm_program.get_main ();
+	if (!main_function) {
+		fprintf (stderr, "error: no main function\n");
+		return EXIT_FAILURE;
+	}
+	vm::Jit* jit = nullptr;
+	if (tiered) {
+		jit = vm::Jit::create (program, vm_program);
+		if (!jit) fprintf (stderr, "warning: rea was built without JIT support\n");
+		vm_program.set_jit (jit);
+	}
+	{
+		profile::Scope scope ("phase", "execution");
+		vm_program.run (main_function);
+	}
+	delete jit;
+	return EXIT_SUCCESS;
+}
+
+static int write_output (Writer& writer, int shards, const char* output_name) {
+	if (shards > 1) {
+		// output.ll becomes output.0.ll, output.1.ll, ...
+		int length = strlen (output_name);
+		if (length > 3 && strcmp (output_name + length - 3, ".ll") == 0) length -= 3;
+		std::vector<int> assignment = writer.partition (shards);
+		for (int shard = 0; shard < shards; ++shard) {
+			char shard_name[4096];
+			snprintf (shard_name, sizeof(shard_name), "%.*s.%d.ll", length, output_name, shard);
+			FILE* file = fopen (shard_name, "w");
+			if (!file) {
+				fprintf (stderr, "error: cannot open file '%s'\n", shard_name);
+				return EXIT_FAILURE;
+			}
+			writer.write (file, assignment, shard);
+			fclose (file);
+		}
+	}
+	else if (output_name) {
+		FILE* file = fopen (output_name, "w");
+		if (!file) {
+			fprintf (stderr, "error: cannot open file '%s'\n", output_name);
+			return EXIT_FAILURE;
+		}
+		writer.write (file);
+		fclose (file);
+	}
+	else {
+		writer.write ();
+	}
+	return EXIT_SUCCESS;
+}
+
+static int compile (int argc, char** argv) {
+	int i = 1;
+	bool run = false;
+	if (i < argc && strcmp (argv[i], "run") == 0) {
+		run = true;
+		++i;
+	}
+	bool tiered = false;
+	int jobs = 1;
+	int shards = 1;
+	bool time_report = false;
+	bool instrument = false;
+	bool optimize_layout = false;
+	bool layout_report = false;
+	bool interface_only = false;
+	writer::DebugInfo debug_info = writer::NO_DEBUG_INFO;
+	const char* trace_name = nullptr;
+	std::vector<Interface*> interfaces;
+	const char* interface_name = nullptr;
+	const char* cache_directory = nullptr;
+	const char* output_name = nullptr;
+	const char* input_name = nullptr;
+	for (; i < argc; ++i) {
+		if (run && strcmp (argv[i], "--tiered") == 0) {
+			tiered = true;
+		}
+		else if (strncmp (argv[i], "-j", 2) == 0) {
+			const char* value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+			jobs = atoi (value);
+			if (jobs < 1) {
+				fprintf (stderr, "error: invalid number of jobs '%s'\n", value);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strncmp (argv[i], "--shards=", 9) == 0) {
+			shards = atoi (argv[i] + 9);
+			if (shards < 1) {
+				fprintf (stderr, "error: invalid number of shards '%s'\n", argv[i] + 9);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!run && strcmp (argv[i], "--instrument") == 0) {
+			instrument = true;
+		}
+		else if (!run && strcmp (argv[i], "--optimize-layout") == 0) {
+			optimize_layout = true;
+		}
+		else if (!run && strcmp (argv[i], "--layout-report") == 0) {
+			layout_report = true;
+		}
+		else if (!run && strcmp (argv[i], "-g") == 0) {
+			debug_info = writer::FULL_DEBUG_INFO;
+		}
+		else if (!run && strcmp (argv[i], "-gline-tables-only") == 0) {
+			debug_info = writer::LINE_TABLES_ONLY;
+		}
+		else if (strcmp (argv[i], "--time-report") == 0) {
+			time_report = true;
+		}
+		else if (strncmp (argv[i], "--trace=", 8) == 0) {
+			trace_name = argv[i] + 8;
+		}
+		else if (strncmp (argv[i], "--interface=", 12) == 0) {
+			Interface* interface = Interface::load (argv[i] + 12);
+			if (!interface) return EXIT_FAILURE;
+			interfaces.push_back (interface);
+		}
+		else if (strncmp (argv[i], "--emit-interface=", 17) == 0) {
+			interface_name = argv[i] + 17;
+		}
+		else if (!run && strcmp (argv[i], "--interface-only") == 0) {
+			interface_only = true;
+		}
+		else if (!run && strncmp (argv[i], "--cache=", 8) == 0) {
+			cache_directory = argv[i] + 8;
+		}
+		else if (strcmp (argv[i], "-o") == 0 && i + 1 < argc) {
+			output_name = argv[++i];
+		}
+		else if (argv[i][0] == '-') {
+			fprintf (stderr, "error: unknown option '%s'\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		else if (input_name) {
+			fprintf (stderr, "error: more than one input file ('%s' and '%s')\n", input_name, argv[i]);
+			return EXIT_FAILURE;
+		}
+		else {
+			input_name = argv[i];
+		}
+	}
+	if (shards > 1 && !output_name) {
+		fprintf (stderr, "error: --shards requires an output file\n");
+		return EXIT_FAILURE;
+	}
+	if (!input_name) {
 		fprintf (stderr, "error: no input file\n");
 		return EXIT_FAILURE;
 	}
-	String input (argv[1]);
+	// the interpreter would need the bodies of the imported functions
+	if (run && !interfaces.empty()) {
+		fprintf (stderr, "error: --interface cannot be used with run, the interpreter needs the bodies of the functions\n");
+		return EXIT_FAILURE;
+	}
+	if (interface_only && !interface_name) {
+		fprintf (stderr, "error: --interface-only requires --emit-interface\n");
+		return EXIT_FAILURE;
+	}
+	profile::enabled = time_report || trace_name;
+	double read_start = profile::get_time ();
+	String input (input_name);
 	if (!input.get_data()) return EXIT_FAILURE;
+	if (profile::enabled) profile::add_event ("phase", "read", read_start, profile::get_time());
 	Cursor cursor (input.get_data());
-	ast::Program* program = Parser(cursor).parse_program ();
-	Writer writer;
-	program->write (writer);
-	writer.write ();
+	if (interface_only) {
+		// the function bodies are not needed, so they may use symbols that are not declared yet
+		ast::Program* program;
+		try {
+			program = Parser(cursor).parse_interface (interfaces);
+		}
+		catch (const Diagnostic& diagnostic) {
+			File file (stderr);
+			diagnostic.print (file);
+			return EXIT_FAILURE;
+		}
+		return Interface::write (interface_name, program) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// the counters and the debug info of functions are not part of the cache entries
+	Cache* cache = cache_directory && !instrument && debug_info == writer::NO_DEBUG_INFO ? new Cache (cache_directory) : nullptr;
+	if (cache && optimize_layout) cache->add_option ("--optimize-layout");
+	ast::Program* program = Parser(cursor).parse_program (jobs, cache, interfaces);
+	if (interface_name && !Interface::write (interface_name, program)) return EXIT_FAILURE;
+	int result;
+	if (run) {
+		result = run_program (program, tiered);
+	}
+	else {
+		Writer writer (instrument);
+		writer.set_debug_info (debug_info, input_name);
+		writer.set_optimize_layout (optimize_layout);
+		{
+			profile::Scope scope ("phase", "codegen");
+			program->write (writer, jobs, cache);
+		}
+		profile::Scope scope ("phase", "emission");
+		result = write_output (writer, shards, output_name);
+		if (layout_report) writer.write_layout_report (stderr);
+	}
+	if (time_report) profile::write_report (stderr);
+	if (trace_name && !profile::write_trace (trace_name)) return EXIT_FAILURE;
+	return result;
+}
+
+int main (int argc, char** argv) {
+	if (argc > 1 && strcmp (argv[1], "build") == 0) {
+		return build (argc - 2, argv + 2);
+	}
+	if (argc > 1 && strcmp (argv[1], "report") == 0) {
+		return report (argc - 2, argv + 2);
+	}
+	if (argc > 1 && strncmp (argv[1], "--server=", 9) == 0) {
+		return serve (argv[1] + 9, argc - 2, argv + 2, compile);
+	}
+	// the same command line can be handled by a running compile server
+	if (const char* server = getenv ("REA_SERVER")) {
+		int status;
+		if (forward (server, argc, argv, status)) return status;
+	}
+	return compile (argc, argv);
 }
@@ -16,20 +16,141 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 */
 
 #include "parser.hpp"
+#include "cache.hpp"
+#include "interface.hpp"
+#include "writer.hpp"
+#include "parallel.hpp"
+#include "escape.hpp"
+#include <mutex>
 
 using namespace ast;
 
+ArrayType::ArrayType (const Type* element_type): element_type(element_type) {
+	const Substring element_name = element_type->get_name ();
+	name = "[" + std::string (element_name.get_data(), element_name.get_length()) + "]";
+}
+
+const ArrayType* ArrayType::get (const Type* element_type) {
+	// the bodies are parsed in parallel
+	static std::mutex mutex;
+	static std::map<const Type*, const ArrayType*> types;
+	std::lock_guard<std::mutex> lock (mutex);
+	const ArrayType*& type = types[element_type];
+	if (!type) type = new ArrayType (element_type);
+	return type;
+}
+
+bool ArrayType::has_columns () const {
+	const Class* _class = element_type->get_class ();
+	return _class && _class->soa;
+}
+
+VectorType::VectorType (const Type* element_type, int lanes): element_type(element_type), lanes(lanes) {
+	const Substring element_name = element_type->get_name ();
+	name = std::string (element_name.get_data(), element_name.get_length()) + std::to_string (lanes);
+}
+
+const VectorType* VectorType::get (const Type* element_type, int lanes) {
+	static std::mutex mutex;
+	static std::map<std::pair<const Type*, int>, const VectorType*> types;
+	std::lock_guard<std::mutex> lock (mutex);
+	const VectorType*& type = types[std::make_pair(element_type, lanes)];
+	if (!type) type = new VectorType (element_type, lanes);
+	return type;
+}
+
+thread_local Pool* Pool::current = nullptr;
+
+Pool::~Pool () {
+	for (auto i = objects.rbegin(); i != objects.rend(); ++i) delete *i;
+}
+
+struct VectorName {
+	const char* name;
+	const Type* element_type;
+	int lanes;
+};
+
+// the lanes fill the 128 bit registers of SSE and the 256 bit registers of AVX2
+static const VectorName vector_names[] = {
+	{"Int4", &Type::INT, 4},
+	{"Int8", &Type::INT, 8},
+	{"Bool4", &Type::BOOL, 4},
+	{"Bool8", &Type::BOOL, 8}
+};
+
+const VectorType* VectorType::get (const Substring& name) {
+	for (const VectorName& vector_name: vector_names) {
+		if (name == vector_name.name) return get (vector_name.element_type, vector_name.lanes);
+	}
+	return nullptr;
+}
+
 const Type* Parser::parse_type () {
-	if (cursor.starts_with("Bool"))
+	if (cursor.starts_with("[")) {
+		cursor.skip_whitespace ();
+		const Type* element_type = parse_type ();
+		cursor.skip_whitespace ();
+		cursor.expect ("]");
+		return ArrayType::get (element_type);
+	}
+	if (cursor.starts_with_keyword("Bool"))
 		return &Type::BOOL;
-	if (cursor.starts_with("Int"))
+	if (cursor.starts_with_keyword("Int"))
 		return &Type::INT;
 	Substring identifier = parse_identifier ();
+	if (const VectorType* vector_type = VectorType::get(identifier))
+		return vector_type;
 	const Type* type = context.get_class (identifier);
 	if (!type) cursor.error ("unknown type '%'", identifier);
 	return type;
 }
 
+// whether the cursor is at a type, like the [Int] of the array creation [Int](n)
+bool Parser::is_type () {
+	const Cursor start = cursor;
+	const bool result = skip_type ();
+	cursor = start;
+	return result;
+}
+
+bool Parser::skip_type () {
+	if (cursor.starts_with("[")) {
+		cursor.skip_whitespace ();
+		if (!skip_type()) return false;
+		cursor.skip_whitespace ();
+		return cursor.starts_with ("]");
+	}
+	if (cursor.starts_with_keyword("Bool") || cursor.starts_with_keyword("Int"))
+		return true;
+	if (cursor[0].is_alphabetic() || *cursor == '_') {
+		Substring identifier = parse_identifier ();
+		return !context.get_variable(identifier) && (VectorType::get(identifier) || context.get_class(identifier));
+	}
+	return false;
+}
+
+// the value of the elements of a new array
+Expression* Parser::create_default_value (const Type* type) {
+	if (type == &Type::INT)
+		return new Number (0);
+	if (type == &Type::BOOL)
+		return new BooleanLiteral (false);
+	if (const ArrayType* array_type = type->get_array())
+		return new ArrayCreation (array_type, new Number(0), create_default_value(array_type->get_element_type()));
+	if (const VectorType* vector_type = type->get_vector()) {
+		VectorCreation* creation = new VectorCreation (vector_type);
+		creation->add_lane (create_default_value(vector_type->get_element_type()));
+		return creation;
+	}
+	Class* _class = context.get_class (type->get_name());
+	if (incomplete_classes.count(_class)) cursor.error ("the attributes of class '%' are not defined yet", type->get_name());
+	Instantiation* instantiation = new Instantiation (_class);
+	if (const Variable* attribute = instantiation->get_uninitialized_attribute())
+		cursor.error ("attribute '%' of class '%' has no default value", attribute->get_name(), type->get_name());
+	return instantiation;
+}
+
 Number* Parser::parse_number () {
 	int n = 0;
 	while (cursor[0].is_numeric()) {
@@ -75,6 +196,39 @@ Expression* Parser::parse_expression_last () {
 		cursor.expect (")");
 		return expression;
 	}
+	else if (*cursor == '[') {
+		// array creation
+		if (is_type()) {
+			const ArrayType* type = parse_type()->get_array ();
+			cursor.skip_whitespace ();
+			cursor.expect ("(");
+			cursor.skip_whitespace ();
+			Expression* length = parse_expression ();
+			if (length->get_type() != &Type::INT) cursor.error ("the length must be of type Int");
+			cursor.skip_whitespace ();
+			cursor.expect (")");
+			return new ArrayCreation (type, length, create_default_value(type->get_element_type()));
+		}
+		
+		// array literal
+		cursor.expect ("[");
+		cursor.skip_whitespace ();
+		if (*cursor == ']') cursor.error ("empty arrays need an element type, like [Int](0)");
+		Expression* element = parse_expression ();
+		if (element->get_type() == &Type::VOID) cursor.error ("arrays of type Void are not allowed");
+		ArrayLiteral* literal = new ArrayLiteral (ArrayType::get(element->get_type()));
+		if (literal->get_type()->get_array()->has_columns()) cursor.error ("arrays of soa classes can only be created with a length");
+		literal->add_element (element);
+		cursor.skip_whitespace ();
+		while (*cursor != ']') {
+			Expression* next = parse_expression ();
+			if (next->get_type() != element->get_type()) cursor.error ("invalid type");
+			literal->add_element (next);
+			cursor.skip_whitespace ();
+		}
+		cursor.expect ("]");
+		return literal;
+	}
 	else if (cursor.starts_with("false")) {
 		return new BooleanLiteral (false);
 	}
@@ -93,9 +247,29 @@ Expression* Parser::parse_expression_last () {
 			return variable;
 		}
 		
+		// vector creation
+		if (const VectorType* type = VectorType::get(identifier)) {
+			VectorCreation* creation = new VectorCreation (type);
+			cursor.skip_whitespace ();
+			cursor.expect ("(");
+			cursor.skip_whitespace ();
+			int count = 0;
+			while (*cursor != ')') {
+				Expression* lane = parse_expression ();
+				if (lane->get_type() != type->get_element_type()) cursor.error ("the lanes of % must be of type %", identifier, type->get_element_type()->get_name());
+				creation->add_lane (lane);
+				++count;
+				cursor.skip_whitespace ();
+			}
+			if (count != 1 && count != type->get_lanes()) cursor.error ("% needs 1 or % lanes", identifier, type->get_lanes());
+			cursor.expect (")");
+			return creation;
+		}
+		
 		// class instantiation
 		Class* _class = context.get_class (identifier);
 		if (_class) {
+			if (incomplete_classes.count(_class)) cursor.error ("the attributes of class '%' are not defined yet", identifier);
 			Instantiation* instantiation = new Instantiation (_class);
 			cursor.skip_whitespace ();
 			cursor.expect ("{");
@@ -113,6 +287,8 @@ Expression* Parser::parse_expression_last () {
 				cursor.skip_whitespace ();
 			}
 			cursor.expect ("}");
+			if (const Variable* attribute = instantiation->get_uninitialized_attribute())
+				cursor.error ("attribute '%' of class '%' has no default value", attribute->get_name(), identifier);
 			return instantiation;
 		}
 		
@@ -140,14 +316,56 @@ Expression* Parser::parse_expression_last () {
 Expression* Parser::parse_expression (int level) {
 	if (level == 6) {
 		Expression* expression = parse_expression_last ();
-		cursor.skip_whitespace ();
-		while (cursor.starts_with(".")) {
+		while (true) {
+			// an index follows the array immediately, a '[' after whitespace starts another element
+			if (cursor.starts_with("[")) {
+				const VectorType* vector_type = expression->get_type()->get_vector ();
+				if (!expression->get_type()->get_array() && !vector_type) cursor.error ("only arrays and vectors can be indexed");
+				cursor.skip_whitespace ();
+				Expression* index_expression = parse_expression ();
+				if (index_expression->get_type() != &Type::INT) cursor.error ("the index must be of type Int");
+				cursor.skip_whitespace ();
+				cursor.expect ("]");
+				if (vector_type) {
+					Lane* lane = new Lane (expression, index_expression);
+					// constant lanes are checked here
+					int value;
+					if (index_expression->get_constant_value(value)) {
+						if (value < 0 || value >= vector_type->get_lanes()) cursor.error ("lane % is out of bounds for %", value, vector_type->get_name());
+						lane->checked = false;
+					}
+					expression = lane;
+					continue;
+				}
+				Index* index = new Index (expression, index_expression);
+				for (IndexRange* range: context.ranges) {
+					if (range->index == index_expression && range->array == expression) range->accesses.push_back (index);
+				}
+				expression = index;
+				// the elements of arrays of soa classes only exist as their attributes
+				if (index->get_array()->get_type()->get_array()->has_columns()) {
+					if (!cursor.starts_with(".")) cursor.error ("elements of arrays of soa classes can only be used through their attributes");
+					cursor.skip_whitespace ();
+					Substring identifier = parse_identifier ();
+					if (!index->get_type()->get_class()->get_attribute(identifier)) cursor.error ("invalid attribute '%'", identifier);
+					expression = new ColumnAccess (index, identifier);
+				}
+				continue;
+			}
+			cursor.skip_whitespace ();
+			if (cursor.starts_with("..", false) || !cursor.starts_with(".")) break;
 			cursor.skip_whitespace ();
 			Substring identifier = parse_identifier ();
 			const Class* _class = expression->get_type()->get_class();
 			if (_class && _class->get_attribute(identifier)) {
 				expression = new AttributeAccess (expression, identifier);
 			}
+			else if (expression->get_type()->get_array() && identifier == "length") {
+				expression = new ArrayLength (expression);
+			}
+			else if (Expression* operation = parse_vector_operation(expression, identifier)) {
+				expression = operation;
+			}
 			else {
 				// method call
 				Call* call = new Call (identifier);
@@ -165,7 +383,6 @@ Expression* Parser::parse_expression (int level) {
 				cursor.expect (")");
 				expression = call;
 			}
-			cursor.skip_whitespace ();
 		}
 		return expression;
 	}
@@ -178,6 +395,12 @@ Expression* Parser::parse_expression (int level) {
 			if (cursor.starts_with(op->identifier)) {
 				cursor.skip_whitespace ();
 				Expression* right = parse_expression (level + 1);
+				// the bounds checks of a loop over an array are needed if the array is replaced
+				if (op->create == Assignment::create) {
+					for (IndexRange* range: context.ranges) {
+						if (range->array == left) range->assigned = true;
+					}
+				}
 				if (op->create) left = op->create (left, right);
 				if (!left->validate()) cursor.error ("invalid operands for operator '%'", op->identifier);
 				match = true;
@@ -187,7 +410,68 @@ Expression* Parser::parse_expression (int level) {
 	return left;
 }
 
+// the operations on vectors that are written like method calls, null for other methods
+Expression* Parser::parse_vector_operation (Expression* vector, const Substring& name) {
+	const VectorType* type = vector->get_type()->get_vector ();
+	if (!type) return nullptr;
+	const bool is_int = type->get_element_type() == &Type::INT;
+	const char* reduction = nullptr;
+	if (is_int && name == "sum") reduction = "add";
+	else if (is_int && name == "min") reduction = "smin";
+	else if (is_int && name == "max") reduction = "smax";
+	else if (!is_int && name == "any") reduction = "or";
+	else if (!is_int && name == "all") reduction = "and";
+	if (reduction) {
+		cursor.skip_whitespace ();
+		cursor.expect ("(");
+		cursor.skip_whitespace ();
+		cursor.expect (")");
+		return new Reduction (reduction, vector);
+	}
+	if (!is_int && name == "select") {
+		cursor.skip_whitespace ();
+		cursor.expect ("(");
+		cursor.skip_whitespace ();
+		Expression* left = parse_expression ();
+		cursor.skip_whitespace ();
+		Expression* right = parse_expression ();
+		const VectorType* result_type = left->get_type()->get_vector ();
+		if (!result_type || result_type->get_lanes() != type->get_lanes() || right->get_type() != result_type)
+			cursor.error ("select needs two vectors of the same type with % lanes", type->get_lanes());
+		cursor.skip_whitespace ();
+		cursor.expect (")");
+		return new Select (vector, left, right);
+	}
+	if (name == "shuffle") {
+		// an optional second vector followed by the constant indices of the lanes
+		cursor.skip_whitespace ();
+		cursor.expect ("(");
+		cursor.skip_whitespace ();
+		Expression* right = nullptr;
+		std::vector<int> indices;
+		while (*cursor != ')') {
+			Expression* argument = parse_expression ();
+			int index;
+			if (!right && indices.empty() && argument->get_type() == type) {
+				right = argument;
+			}
+			else {
+				if (argument->get_type() != &Type::INT || !argument->get_constant_value(index)) cursor.error ("the lanes of a shuffle must be constants");
+				if (index < 0 || index >= (right ? 2 : 1) * type->get_lanes()) cursor.error ("lane % is out of bounds", index);
+				indices.push_back (index);
+			}
+			cursor.skip_whitespace ();
+		}
+		const VectorType* result_type = VectorType::get (type->get_element_type(), indices.size());
+		if (!VectorType::get(result_type->get_name())) cursor.error ("a shuffle must select 4 or 8 lanes");
+		cursor.expect (")");
+		return new Shuffle (result_type, vector, right, indices);
+	}
+	return nullptr;
+}
+
 Node* Parser::parse_variable_definition () {
+	const int line = cursor.get_line ();
 	cursor.expect ("var");
 	cursor.skip_whitespace ();
 	Substring name = parse_identifier ();
@@ -197,7 +481,7 @@ Node* Parser::parse_variable_definition () {
 	cursor.skip_whitespace ();
 	Expression* expression = parse_expression ();
 	if (expression->get_type() == &Type::VOID) cursor.error ("variables of type Void are not allowed");
-	Expression* variable = context.add_variable (name, expression->get_type());
+	Expression* variable = context.add_variable (name, expression->get_type(), line);
 	Assignment* assignment = new Assignment (variable, expression);
 	return new ExpressionNode (assignment);
 }
@@ -212,6 +496,12 @@ Node* Parser::parse_line () {
 	else if (cursor.starts_with("while", false)) {
 		return parse_while ();
 	}
+	else if (cursor.starts_with_contextual_keyword("for", "a", false)) {
+		return parse_for ();
+	}
+	else if (cursor.starts_with_contextual_keyword("region", "{", false)) {
+		return parse_region ();
+	}
 	else if (cursor.starts_with("return")) {
 		const Type* return_type = context.get_return_type ();
 		Expression* expression = nullptr;
@@ -220,6 +510,9 @@ Node* Parser::parse_line () {
 			expression = parse_expression ();
 			if (expression->get_type() != return_type)
 				cursor.error ("invalid return type");
+			// the instance would be freed together with the region
+			if ((return_type->get_class() || return_type->get_array()) && context.regions > 0)
+				cursor.error ("instances and arrays cannot be returned from inside a region");
 		}
 		context.set_returned ();
 		return new Return (expression);
@@ -236,7 +529,9 @@ void Parser::parse_block (Block* block) {
 	cursor.expect ("{");
 	cursor.skip_whitespace ();
 	while (*cursor != '}' && !block->returns && *cursor != '\0') {
+		const int line = cursor.get_line ();
 		Node* node = parse_line ();
+		node->line = line;
 		block->add_node (node);
 		cursor.skip_whitespace ();
 	}
@@ -245,12 +540,21 @@ void Parser::parse_block (Block* block) {
 	context.block = block->parent;
 }
 
+Likelihood Parser::parse_likelihood () {
+	Likelihood likelihood = UNKNOWN;
+	if (cursor.starts_with_contextual_keyword("likely", "a([")) likelihood = LIKELY;
+	else if (cursor.starts_with_contextual_keyword("unlikely", "a([")) likelihood = UNLIKELY;
+	cursor.skip_whitespace ();
+	return likelihood;
+}
+
 If* Parser::parse_if () {
 	cursor.expect ("if");
 	cursor.skip_whitespace ();
+	Likelihood likelihood = parse_likelihood ();
 	Expression* condition = parse_expression ();
 	if (condition->get_type() != &Type::BOOL) cursor.error ("condition must be of type Bool");
-	If* result = new If (condition);
+	If* result = new If (condition, likelihood);
 	cursor.skip_whitespace ();
 	parse_block (result->if_block);
 	return result;
@@ -259,30 +563,104 @@ If* Parser::parse_if () {
 While* Parser::parse_while () {
 	cursor.expect ("while");
 	cursor.skip_whitespace ();
+	Likelihood likelihood = parse_likelihood ();
 	Expression* condition = parse_expression ();
 	if (condition->get_type() != &Type::BOOL) cursor.error ("condition must be of type Bool");
-	While* result = new While (condition);
+	While* result = new While (condition, likelihood);
 	cursor.skip_whitespace ();
 	parse_block (result->block);
 	return result;
 }
 
-void Parser::parse_function () {
-	Context previous_context = context;
-	
+For* Parser::parse_for () {
+	const int line = cursor.get_line ();
+	cursor.expect ("for");
+	cursor.skip_whitespace ();
+	Substring name = parse_identifier ();
+	if (context.get_variable(name)) cursor.error ("the variable '%' is already defined", name);
+	cursor.skip_whitespace ();
+	if (!cursor.starts_with_keyword("in")) cursor.error ("expected 'in'");
+	cursor.skip_whitespace ();
+	For* result = new For ();
+	Expression* expression = parse_expression ();
+	cursor.skip_whitespace ();
+	// the variables belong to the block of the loop
+	Block* parent = context.block;
+	result->block->parent = parent;
+	context.block = result->block;
+	IndexRange* range = nullptr;
+	if (cursor.starts_with("..")) {
+		if (expression->get_type() != &Type::INT) cursor.error ("the start of the range must be of type Int");
+		cursor.skip_whitespace ();
+		result->start = expression;
+		result->expression = parse_expression ();
+		if (result->expression->get_type() != &Type::INT) cursor.error ("the end of the range must be of type Int");
+		result->variable = context.add_variable (name, &Type::INT, line);
+		result->index = result->variable;
+		// an index from a non-negative start up to the length of an array is inside its bounds
+		int start;
+		Expression* array = result->expression->get_length_of ();
+		if (array && result->start->get_constant_value(start) && start >= 0) {
+			range = new IndexRange {result->index, array, false};
+			context.ranges.push_back (range);
+		}
+	}
+	else {
+		const ArrayType* type = expression->get_type()->get_array ();
+		if (!type) cursor.error ("expected a range or an array");
+		if (type->has_columns()) cursor.error ("the elements of arrays of soa classes can only be iterated by their index");
+		result->expression = expression;
+		result->variable = context.add_variable (name, type->get_element_type(), line);
+		result->array = context.add_variable ("", type);
+		result->index = context.add_variable ("", &Type::INT);
+	}
+	result->variable->read_only = true;
+	result->end = context.add_variable ("", &Type::INT);
+	context.block = parent;
+	cursor.skip_whitespace ();
+	parse_block (result->block);
+	if (range) {
+		context.ranges.pop_back ();
+		if (!range->assigned) {
+			for (Index* access: range->accesses) access->checked = false;
+		}
+		delete range;
+	}
+	// the loop might not be executed, so its return does not end the parent block
+	return result;
+}
+
+Region* Parser::parse_region () {
+	cursor.expect ("region");
+	cursor.skip_whitespace ();
+	Region* result = new Region ();
+	context.has_regions = true;
+	++context.regions;
+	parse_block (result->block);
+	--context.regions;
+	// the block is always executed
+	if (result->block->returns) context.set_returned ();
+	return result;
+}
+
+// parses the signature and skips the body, which is parsed later
+Function* Parser::parse_function () {
+	const char* start = cursor.get_pointer ();
+	const int line = cursor.get_line ();
+	const bool cold = cursor.starts_with_keyword ("cold");
+	if (cold) cursor.skip_whitespace ();
 	cursor.expect ("func");
 	cursor.skip_whitespace ();
 	
 	// name
 	Substring name = parse_identifier ();
-	Function* function = new Function (name);
-	context.function = function;
-	context._class = nullptr;
+	Function* function = new Function (name, line);
+	function->cold = cold;
 	cursor.skip_whitespace ();
 	
 	// argument list
-	if (previous_context._class) {
-		function->add_argument ("this", previous_context._class);
+	if (context._class) {
+		function->add_argument ("this", context._class);
 	}
 	cursor.expect("(");
 	cursor.skip_whitespace ();
@@ -311,21 +689,44 @@ void Parser::parse_function () {
 	context.add_function (function);
 	
 	// code block
+	if (*cursor != '{') cursor.error ("expected '{'");
+	Cursor body = cursor;
+	cursor.skip_block ();
+	function_bodies.push_back (FunctionBody {function, body, Substring(start, cursor.get_pointer() - start)});
+	
+	return function;
+}
+
+void Parser::parse_function_body (Function* function) {
+	context.function = function;
+	context._class = nullptr;
+	context.has_regions = false;
+	const Cursor start = cursor;
 	parse_block (function->block);
 	if (function->get_return_type() != &Type::VOID && !function->block->returns)
 		cursor.error ("missing return statement");
-	
-	context = previous_context;
+	if (context.has_regions) check_regions (function, start);
 }
 
+// the whole function is needed to know which objects come from outside of a region
+void Parser::check_regions (Function* function, Cursor cursor) {
+	EscapeAnalysis analysis (function, true);
+	const Node* node = analysis.get_region_error ();
+	if (!node) return;
+	while (cursor.get_line() < node->line && *cursor != '\0') cursor.advance ();
+	cursor.skip_whitespace ();
+	cursor.error (analysis.get_region_message());
+}
+
+// collects the methods of the class and skips its attributes, which are parsed later
 void Parser::parse_class () {
 	Context previous_context = context;
 	
+	while (cursor.starts_with_keyword("packed") || cursor.starts_with_keyword("soa")) cursor.skip_whitespace ();
 	cursor.expect ("class");
 	cursor.skip_whitespace ();
 	Substring name = parse_identifier ();
-	Class* _class = new Class (name);
-	context.add_class (_class);
+	Class* _class = context.get_class (name);
 	context._class = _class;
 	context.function = nullptr;
 	cursor.skip_whitespace ();
@@ -334,16 +735,12 @@ void Parser::parse_class () {
 	while (*cursor != '}' && *cursor != '\0') {
 		if (cursor.starts_with("var")) {
 			cursor.skip_whitespace ();
-			Substring attribute_name = parse_identifier ();
-			if (_class->get_attribute(attribute_name)) cursor.error ("duplicate attribute name '%'", attribute_name);
-			cursor.skip_whitespace ();
-			cursor.expect ("=");
-			cursor.skip_whitespace ();
-			Expression* expression = parse_expression ();
-			if (expression->get_type() == &Type::VOID) cursor.error ("attributes of type Void are not allowed");
-			_class->add_attribute (attribute_name, expression);
+			Cursor attribute = cursor;
+			cursor.skip_attribute ();
+			class_attributes.push_back (ClassAttribute {_class, attribute, Substring(attribute.get_pointer(), cursor.get_pointer() - attribute.get_pointer())});
+			incomplete_classes.insert (_class);
 		}
-		else if (cursor.starts_with("func", false)) {
+		else if (cursor.starts_with_keyword("func", false) || cursor.starts_with_keyword("cold", false)) {
 			parse_function ();
 		}
 		else {
@@ -356,6 +753,78 @@ void Parser::parse_class () {
 	context = previous_context;
 }
 
+void Parser::parse_attribute (Class* _class) {
+	Substring attribute_name = parse_identifier ();
+	if (_class->get_attribute(attribute_name)) cursor.error ("duplicate attribute name '%'", attribute_name);
+	cursor.skip_whitespace ();
+	cursor.expect ("=");
+	cursor.skip_whitespace ();
+	const char* start = cursor.get_pointer ();
+	Expression* expression = parse_expression ();
+	if (expression->get_type() == &Type::VOID) cursor.error ("attributes of type Void are not allowed");
+	_class->add_attribute (attribute_name, expression);
+	_class->set_default_source (Substring(start, cursor.get_pointer() - start));
+	cursor.skip_whitespace ();
+	if (!(*cursor == '}' || cursor.starts_with_keyword("var", false) || cursor.starts_with_keyword("func", false) || cursor.starts_with_keyword("cold", false)))
+		cursor.error ("unexpected character");
+}
+
+// a class definition, optionally preceded by 'packed' and 'soa'
+static bool starts_with_class (Cursor& cursor) {
+	return cursor.starts_with("class", false) || cursor.starts_with_keyword("packed", false) || cursor.starts_with_keyword("soa", false);
+}
+
+// collects the names of all classes so they can be used before their definition
+void Parser::declare_classes () {
+	cursor.skip_whitespace ();
+	while (*cursor != '\0') {
+		if (starts_with_class(cursor)) {
+			bool packed = false;
+			bool soa = false;
+			while (true) {
+				if (cursor.starts_with_keyword("packed")) packed = true;
+				else if (cursor.starts_with_keyword("soa")) soa = true;
+				else break;
+				cursor.skip_whitespace ();
+			}
+			cursor.expect ("class");
+			cursor.skip_whitespace ();
+			Substring name = parse_identifier ();
+			if (context.get_class(name)) cursor.error ("class '%' already defined", name);
+			Class* _class = new Class (name);
+			_class->packed = packed;
+			_class->soa = soa;
+			context.add_class (_class);
+			cursor.skip_to_block ();
+			cursor.skip_block ();
+		}
+		else if (cursor.starts_with_keyword("func") || cursor.starts_with_keyword("cold")) {
+			cursor.skip_to_block ();
+			cursor.skip_block ();
+		}
+		else {
+			cursor.error ("unexpected character");
+		}
+		cursor.skip_whitespace ();
+	}
+}
+
+void Parser::parse_declarations () {
+	cursor.skip_whitespace ();
+	while (*cursor != '\0') {
+		if (cursor.starts_with_keyword("func", false) || cursor.starts_with_keyword("cold", false)) {
+			parse_function ();
+		}
+		else if (starts_with_class(cursor)) {
+			parse_class ();
+		}
+		else {
+			cursor.error ("unexpected character");
+		}
+		cursor.skip_whitespace ();
+	}
+}
+
 static FunctionDeclaration* create_function (const char* name, std::initializer_list<const Type*> arguments, const Type* return_type = &Type::VOID) {
 	FunctionDeclaration* function = new FunctionDeclaration (name);
 	for (const Type* type: arguments)
@@ -364,22 +833,158 @@ static FunctionDeclaration* create_function (const char* name, std::initializer_
 	return function;
 }
 
-Program* Parser::parse_program () {
+// the key of a class covers its layout and the default values of its attributes
+uint64_t Parser::get_class_key (const Class* _class, const std::map<const Class*, Hash>& attributes) {
+	auto i = class_keys.find (_class);
+	if (i != class_keys.end()) return i->second;
+	auto source = attributes.find (_class);
+	// imported classes are covered by the hash of their interface
+	if (source == attributes.end()) return get_class_key (_class);
+	Hash hash = source->second;
+	if (_class->packed) hash.add ("packed");
+	if (_class->soa) hash.add ("soa");
+	for (Variable* attribute: _class->get_attributes()) {
+		hash.add (attribute->get_name());
+		hash.add (attribute->get_type()->get_name());
+		const Type* type = attribute->get_type ();
+		while (const ArrayType* array_type = type->get_array()) type = array_type->get_element_type ();
+		if (const Class* attribute_class = type->get_class())
+			hash.add (get_class_key(attribute_class, attributes));
+	}
+	return class_keys[_class] = hash.get ();
+}
+
+uint64_t Parser::get_class_key (const Class* _class) const {
+	auto i = class_keys.find (_class);
+	if (i != class_keys.end()) return i->second;
+	// classes without attributes
+	Hash hash;
+	hash.add (_class->get_name());
+	return hash.get ();
+}
+
+void Parser::add_type (Hash& hash, const Type* type) const {
+	hash.add (type->get_name());
+	if (const ArrayType* array_type = type->get_array()) add_type (hash, array_type->get_element_type());
+	if (const Class* _class = type->get_class()) hash.add (get_class_key(_class));
+}
+
+void Parser::add_signature (Hash& hash, const FunctionDeclaration* function) const {
+	hash.add (function->get_name());
+	for (int i = 0; const Type* argument = function->get_argument(i); ++i) add_type (hash, argument);
+	add_type (hash, function->get_return_type());
+}
+
+// the generated code of a function only depends on its source and the interfaces of
+// the functions and classes it refers to, all of which are named by identifiers
+uint64_t Parser::get_key (const FunctionBody& body, uint64_t seed) const {
+	Hash hash;
+	hash.add (seed);
+	hash.add (body.text);
+	add_signature (hash, body.function);
+	const char* s = body.text.get_data ();
+	const char* end = s + body.text.get_length ();
+	while (s < end) {
+		if (!Character(*s).is_alphanumeric() && *s != '_') {
+			++s;
+			continue;
+		}
+		const char* start = s;
+		while (s < end && (Character(*s).is_alphanumeric() || *s == '_')) ++s;
+		if (Character(*start).is_numeric()) continue;
+		Substring name (start, s - start);
+		if (const std::vector<FunctionDeclaration*>* functions = context.program->get_functions(name)) {
+			for (const FunctionDeclaration* function: *functions) add_signature (hash, function);
+		}
+		if (const Class* _class = context.program->get_class(name)) {
+			hash.add (get_class_key(_class));
+		}
+	}
+	return hash.get ();
+}
+
+Program* Parser::parse_interface (const std::vector<Interface*>& interfaces) {
 	Program* program = new Program ();
+	for (Interface* interface: interfaces) program->add_interface (interface);
 	context.program = program;
 	program->add_function_declaration (create_function("print", {&Type::INT}));
-	cursor.skip_whitespace ();
-	while (*cursor != '\0') {
-		if (cursor.starts_with("func", false)) {
-			parse_function ();
-		}
-		else if (cursor.starts_with("class", false)) {
-			parse_class ();
+	
+	// declarations
+	Cursor start = cursor;
+	declare_classes ();
+	cursor = start;
+	parse_declarations ();
+	
+	// attributes in source order
+	for (int i = 0; i < class_attributes.size(); ++i) {
+		Class* _class = class_attributes[i]._class;
+		cursor = class_attributes[i].cursor;
+		context._class = _class;
+		parse_attribute (_class);
+		if (i + 1 == class_attributes.size() || class_attributes[i+1]._class != _class)
+			incomplete_classes.erase (_class);
+	}
+	context._class = nullptr;
+	
+	return program;
+}
+
+void Parser::parse_function_body (Program* program, Function* function, Cursor cursor) {
+	Parser parser (cursor);
+	parser.context.program = program;
+	parser.parse_function_body (function);
+}
+
+Expression* Parser::parse_default_value (Program* program, Class* _class, const char* source) {
+	Cursor cursor (source);
+	Parser parser (cursor);
+	parser.context.program = program;
+	parser.context._class = _class;
+	return parser.parse_expression ();
+}
+
+Program* Parser::parse_program (int jobs, Cache* cache, const std::vector<Interface*>& interfaces) {
+	Program* program;
+	try {
+		profile::Scope scope ("phase", "declarations");
+		program = parse_interface (interfaces);
+	}
+	catch (const Diagnostic& diagnostic) {
+		File file (stderr);
+		diagnostic.print (file);
+		exit (EXIT_FAILURE);
+	}
+	
+	uint64_t seed = 0;
+	if (cache) {
+		std::map<const Class*, Hash> attributes;
+		for (const ClassAttribute& attribute: class_attributes) attributes[attribute._class].add (attribute.text);
+		for (auto& i: attributes) get_class_key (i.first, attributes);
+		// imported classes and functions are covered by the hashes of the interfaces
+		for (Interface* interface: interfaces) cache->add_option (interface->get_hash());
+		seed = cache->get_seed ();
+	}
+	
+	// function bodies only depend on declarations and can be parsed independently
+	profile::Scope scope ("phase", "function bodies");
+	std::vector<Diagnostic*> errors (function_bodies.size());
+	parallel_for (jobs, function_bodies.size(), [&] (int i) {
+		// the bodies of cached functions are not needed
+		if (cache && cache->load (function_bodies[i].function, get_key (function_bodies[i], seed))) return;
+		profile::Scope scope ("parse", profile::enabled ? writer::get_mangled_name(function_bodies[i].function) : std::string());
+		try {
+			parse_function_body (program, function_bodies[i].function, function_bodies[i].cursor);
 		}
-		else {
-			cursor.error ("unexpected character");
+		catch (const Diagnostic& diagnostic) {
+			errors[i] = new Diagnostic (diagnostic);
 		}
-		cursor.skip_whitespace ();
+	});
+	for (Diagnostic* error: errors) {
+		if (!error) continue;
+		File file (stderr);
+		error->print (file);
+		exit (EXIT_FAILURE);
 	}
+	
 	return program;
 }
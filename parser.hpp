@@ -17,6 +17,8 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #include "ast.hpp"
 #include <cstdio>
+#include <set>
+#include <string>
 
 #define CSI "\e["
 #define RESET CSI "m"
@@ -26,29 +28,51 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 using namespace ast;
 
-class Cursor {
-	const char* string;
-	int position;
+// errors are thrown as diagnostics so that callers like editors can recover from them
+struct Diagnostic {
 	int line;
-	void print_position (File& file) {
-		for (int i = 0; string[i] != '\n' && string[i] != '\0'; i++)
-			file.print (string[i]);
+	int column;
+	std::string message;
+	// the line that contains the error
+	std::string source;
+	void print (File& file) const {
+		file.print (BOLD "line %: " RED "error: " RESET BOLD, line);
+		file.print (message.c_str());
+		file.print (RESET "\n");
+		file.print (source.c_str());
 		file.print ('\n');
-		for (int i = 0; i < position; i++) {
-			if (string[i] == '\t') file.print ('\t');
+		for (int i = 0; i < column; i++) {
+			if (source[i] == '\t') file.print ('\t');
 			else file.print (' ');
 		}
 		file.print (BOLD "^" RESET "\n");
 	}
+};
+
+class Cursor {
+	const char* string;
+	int position;
+	int line;
 public:
-	Cursor(const char* string): string(string), position(0), line(1) {}
+	Cursor(const char* string, int line = 1): string(string), position(0), line(line) {}
 	template <class... T> void error (const char* s, const T&... v) {
-		File file (stderr);
-		file.print (BOLD "line %: " RED "error: " RESET BOLD, line);
-		file.print (s, v...);
-		file.print (RESET "\n");
-		print_position (file);
-		exit (EXIT_FAILURE);
+		Diagnostic diagnostic;
+		diagnostic.line = line;
+		diagnostic.column = position;
+		char* buffer;
+		size_t size;
+		FILE* stream = open_memstream (&buffer, &size);
+		File (stream).print (s, v...);
+		fclose (stream);
+		diagnostic.message.assign (buffer, size);
+		free (buffer);
+		int length = 0;
+		while (string[length] != '\n' && string[length] != '\0') ++length;
+		diagnostic.source.assign (string, length);
+		throw diagnostic;
+	}
+	int get_line () const {
+		return line;
 	}
 	void advance () {
 		if (string[position] == '\n') {
@@ -92,6 +116,65 @@ public:
 				return false;
 		}
 	}
+	bool starts_with_keyword (const char* s, bool adv = true) {
+		int length = strlen (s);
+		Character next = string[position+length];
+		if (next.is_alphanumeric() || next == '_') return false;
+		return starts_with (s, adv);
+	}
+	// a keyword that can also be the name of a variable, it is only a keyword if the next token
+	// starts with one of the characters, where 'a' stands for letters, digits and '_'
+	bool starts_with_contextual_keyword (const char* s, const char* next, bool adv = true) {
+		if (!starts_with_keyword (s, false)) return false;
+		int i = position + strlen (s);
+		while (Character(string[i]).is_whitespace()) ++i;
+		const Character c = string[i];
+		if (c.is_alphanumeric() || c == '_') {
+			if (!strchr (next, 'a')) return false;
+		}
+		else if (string[i] == '\0' || !strchr (next, string[i])) {
+			return false;
+		}
+		return starts_with (s, adv);
+	}
+	// skips a block including its nested blocks
+	void skip_block () {
+		int depth = 0;
+		do {
+			skip_whitespace ();
+			if (string[position] == '\0') return;
+			if (string[position] == '{') ++depth;
+			else if (string[position] == '}') --depth;
+			advance ();
+		} while (depth > 0);
+	}
+	// skips everything up to the next unnested '{'
+	void skip_to_block () {
+		skip_whitespace ();
+		while (string[position] != '{' && string[position] != '\0') {
+			advance ();
+			skip_whitespace ();
+		}
+	}
+	// skips an expression up to the next 'var', 'func' or unmatched '}'
+	void skip_attribute () {
+		int depth = 0;
+		while (true) {
+			skip_whitespace ();
+			Character c = string[position];
+			if (c == '\0') return;
+			if (depth == 0 && (c == '}' || starts_with_keyword("var", false) || starts_with_keyword("func", false) || starts_with_keyword("cold", false))) return;
+			if (c == '{' || c == '(') ++depth;
+			else if (c == '}' || c == ')') --depth;
+			if (c.is_alphanumeric() || c == '_') {
+				while (Character(string[position]).is_alphanumeric() || string[position] == '_')
+					advance ();
+			}
+			else {
+				advance ();
+			}
+		}
+	}
 	bool expect (const char* s) {
 		if (!starts_with(s)) {
 			error ("expected '%'", s);
@@ -102,6 +185,9 @@ public:
 	}
 	void expect_end () {
 		
+	}
+	const char* get_pointer () const {
+		return string + position;
 	}
 	Substring get_substring (int length) const {
 		return Substring (string + position, length);
@@ -118,14 +204,29 @@ public:
 	}
 };
 
+// a loop over the indices of an array whose accesses with the loop variable need no bounds
+// checks as long as the array variable is not assigned inside the loop
+struct IndexRange {
+	Variable* index;
+	Expression* array;
+	bool assigned;
+	std::vector<Index*> accesses;
+};
+
 class Context {
 public:
 	Program* program;
 	Class* _class;
 	Function* function;
 	Block* block;
+	// the number of enclosing regions
+	int regions;
+	// whether the function contains a region
+	bool has_regions;
+	// the enclosing loops over the indices of arrays
+	std::vector<IndexRange*> ranges;
 public:
-	Context (): program(nullptr), _class(nullptr), function(nullptr), block(nullptr) {}
+	Context (): program(nullptr), _class(nullptr), function(nullptr), block(nullptr), regions(0), has_regions(false) {}
 	Class* get_class (const Substring& name) {
 		return program->get_class (name);
 	}
@@ -147,8 +248,8 @@ public:
 		}
 		return nullptr;
 	}
-	Expression* add_variable (const Substring& name, const Type* type) {
-		Variable* variable = new Variable (name, type);
+	Variable* add_variable (const Substring& name, const Type* type, int line = 0) {
+		Variable* variable = new Variable (name, type, line);
 		if (function && block) {
 			function->add_variable (variable);
 			block->add_variable (variable);
@@ -165,21 +266,64 @@ public:
 };
 
 class Parser {
+public:
+	struct FunctionBody {
+		Function* function;
+		Cursor cursor;
+		// the source of the whole function
+		Substring text;
+	};
+private:
+	struct ClassAttribute {
+		Class* _class;
+		Cursor cursor;
+		Substring text;
+	};
 	Context context;
 	Cursor& cursor;
+	std::vector<FunctionBody> function_bodies;
+	std::vector<ClassAttribute> class_attributes;
+	std::set<const Class*> incomplete_classes;
+	std::map<const Class*, uint64_t> class_keys;
+	void declare_classes ();
+	void parse_declarations ();
+	void parse_attribute (Class* _class);
+	void parse_function_body (Function* function);
+	void check_regions (Function* function, Cursor cursor);
+	uint64_t get_class_key (const Class* _class, const std::map<const Class*, Hash>& attributes);
+	uint64_t get_class_key (const Class* _class) const;
+	void add_type (Hash& hash, const Type* type) const;
+	void add_signature (Hash& hash, const FunctionDeclaration* function) const;
+	uint64_t get_key (const FunctionBody& body, uint64_t seed) const;
 public:
 	Parser (Cursor& cursor): cursor(cursor) {}
 	const Type* parse_type ();
+	bool is_type ();
+	bool skip_type ();
+	Expression* create_default_value (const Type* type);
 	Number* parse_number ();
 	Substring parse_identifier ();
 	Expression* parse_expression (int level = 0);
 	Expression* parse_expression_last ();
+	Expression* parse_vector_operation (Expression* vector, const Substring& name);
 	Node* parse_variable_definition ();
 	Node* parse_line ();
 	void parse_block (Block* block);
+	Likelihood parse_likelihood ();
 	If* parse_if ();
 	While* parse_while ();
-	void parse_function ();
+	For* parse_for ();
+	Region* parse_region ();
+	Function* parse_function ();
 	void parse_class ();
-	Program* parse_program ();
+	// parses the classes and function signatures but not the function bodies
+	Program* parse_interface (const std::vector<Interface*>& interfaces = std::vector<Interface*>());
+	const std::vector<FunctionBody>& get_function_bodies () const {
+		return function_bodies;
+	}
+	static void parse_function_body (Program* program, Function* function, Cursor cursor);
+	// the default value of an attribute of an imported class, see Interface
+	static Expression* parse_default_value (Program* program, Class* _class, const char* source);
+	// parses everything, reports the first error and exits if there is one
+	Program* parse_program (int jobs = 1, Cache* cache = nullptr, const std::vector<Interface*>& interfaces = std::vector<Interface*>());
 };
@@ -0,0 +1,148 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <malloc.h>
+#include <sys/resource.h>
+
+namespace profile {
+
+bool enabled = false;
+std::atomic<long> nodes (0);
+std::atomic<long> instructions (0);
+
+namespace {
+
+struct Event {
+	const char* category;
+	std::string name;
+	int thread;
+	double start;
+	double end;
+};
+
+const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now ();
+std::mutex mutex;
+std::vector<Event> events;
+std::atomic<int> thread_count (0);
+
+int get_thread () {
+	thread_local int thread = thread_count++;
+	return thread;
+}
+
+long get_peak_rss () {
+	struct rusage usage;
+	if (getrusage (RUSAGE_SELF, &usage) != 0) return 0;
+	return usage.ru_maxrss * 1024L;
+}
+
+// the compiler rarely frees memory, so this is close to the number of allocated bytes
+long get_heap_bytes () {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2 ();
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+void write_json_string (FILE* file, const std::string& s) {
+	fputc ('"', file);
+	for (char c: s) {
+		if (c == '"' || c == '\\') fputc ('\\', file);
+		if ((unsigned char)c < 0x20) fprintf (file, "\\u%04x", c);
+		else fputc (c, file);
+	}
+	fputc ('"', file);
+}
+
+}
+
+double get_time () {
+	return std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now() - start_time).count ();
+}
+
+void add_event (const char* category, const std::string& name, double start, double end) {
+	int thread = get_thread ();
+	std::lock_guard<std::mutex> lock (mutex);
+	events.push_back (Event {category, name, thread, start, end});
+}
+
+void write_report (FILE* file) {
+	std::lock_guard<std::mutex> lock (mutex);
+	double total = 0;
+	for (const Event& event: events) total = std::max (total, event.end);
+	fprintf (file, "%-24s %12s %8s\n", "phase", "time (ms)", "%");
+	for (const Event& event: events) {
+		if (strcmp (event.category, "phase") != 0) continue;
+		double duration = event.end - event.start;
+		fprintf (file, "%-24s %12.3f %7.1f%%\n", event.name.c_str(), duration / 1000, total > 0 ? duration / total * 100 : 0);
+	}
+	fprintf (file, "%-24s %12.3f\n\n", "total", total / 1000);
+	
+	// the functions that took the most time over all phases
+	std::map<std::string, double> functions;
+	for (const Event& event: events) {
+		if (strcmp (event.category, "phase") != 0) functions[event.name] += event.end - event.start;
+	}
+	std::vector<std::pair<double, std::string>> slowest;
+	for (auto& function: functions) slowest.push_back (std::make_pair(function.second, function.first));
+	std::sort (slowest.rbegin(), slowest.rend());
+	if (!slowest.empty()) {
+		fprintf (file, "%-24s %12s\n", "function", "time (ms)");
+		for (int i = 0; i < slowest.size() && i < 10; ++i) {
+			fprintf (file, "%-24s %12.3f\n", slowest[i].second.c_str(), slowest[i].first / 1000);
+		}
+		fprintf (file, "\n");
+	}
+	
+	fprintf (file, "%-24s %12zu\n", "functions", functions.size());
+	fprintf (file, "%-24s %12ld\n", "nodes", nodes.load());
+	fprintf (file, "%-24s %12ld\n", "instructions", instructions.load());
+	fprintf (file, "%-24s %12ld\n", "heap bytes", get_heap_bytes());
+	fprintf (file, "%-24s %12ld\n", "peak RSS bytes", get_peak_rss());
+}
+
+bool write_trace (const char* path) {
+	FILE* file = fopen (path, "w");
+	if (!file) {
+		fprintf (stderr, "error: cannot open file '%s'\n", path);
+		return false;
+	}
+	std::lock_guard<std::mutex> lock (mutex);
+	fprintf (file, "{\"traceEvents\": [\n");
+	for (const Event& event: events) {
+		fprintf (file, "{\"name\": ");
+		write_json_string (file, event.name);
+		fprintf (file, ", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f},\n", event.category, event.thread, event.start, event.end - event.start);
+	}
+	double end = get_time ();
+	fprintf (file, "{\"name\": \"memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"heap bytes\": %ld, \"peak RSS bytes\": %ld}},\n", end, get_heap_bytes(), get_peak_rss());
+	fprintf (file, "{\"name\": \"counts\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"nodes\": %ld, \"instructions\": %ld}}\n", end, nodes.load(), instructions.load());
+	fprintf (file, "]}\n");
+	return fclose (file) == 0;
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+// timings and counts for --time-report and --trace
+namespace profile {
+
+extern bool enabled;
+extern std::atomic<long> nodes;
+extern std::atomic<long> instructions;
+
+// microseconds since the start of the compiler
+double get_time ();
+void add_event (const char* category, const std::string& name, double start, double end);
+
+// measures the lifetime of the scope
+class Scope {
+	const char* category;
+	std::string name;
+	double start;
+public:
+	Scope (const char* category, const std::string& name): category(category), name(enabled ? name : std::string()), start(enabled ? get_time() : 0) {}
+	~Scope () {
+		if (enabled) add_event (category, name, start, get_time());
+	}
+};
+
+inline void count_node () {
+	if (enabled) nodes.fetch_add (1, std::memory_order_relaxed);
+}
+inline void count_instruction () {
+	if (enabled) instructions.fetch_add (1, std::memory_order_relaxed);
+}
+
+void write_report (FILE* file);
+// writes the events in the Chrome trace format, which Perfetto can open as well
+bool write_trace (const char* path);
+
+}
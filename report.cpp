@@ -0,0 +1,103 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "report.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct Counter {
+	std::string kind;
+	std::string function;
+	int line;
+	unsigned long long count;
+};
+
+struct Loop {
+	unsigned long long entries = 0;
+	unsigned long long iterations = 0;
+};
+
+}
+
+int report (int argc, char** argv) {
+	const char* path = argc > 0 ? argv[0] : "rea.profile";
+	FILE* file = fopen (path, "r");
+	if (!file) {
+		fprintf (stderr, "error: cannot open file '%s'\n", path);
+		return EXIT_FAILURE;
+	}
+	std::vector<Counter> counters;
+	char kind[64];
+	char function[4096];
+	int line;
+	unsigned long long count;
+	while (fscanf (file, "%63s %4095s %d %llu", kind, function, &line, &count) == 4) {
+		counters.push_back (Counter {kind, function, line, count});
+	}
+	fclose (file);
+	
+	// functions by the number of executed blocks, which approximates the time spent in them
+	std::map<std::string, std::pair<unsigned long long, unsigned long long>> functions;
+	std::map<std::tuple<std::string, int>, Loop> loops;
+	for (const Counter& counter: counters) {
+		if (counter.kind == "function") functions[counter.function].first += counter.count;
+		functions[counter.function].second += counter.count;
+		if (counter.kind == "loop") loops[std::make_tuple(counter.function, counter.line)].entries += counter.count;
+		if (counter.kind == "iteration") loops[std::make_tuple(counter.function, counter.line)].iterations += counter.count;
+	}
+	std::vector<std::tuple<unsigned long long, unsigned long long, std::string>> hottest;
+	for (auto& i: functions) hottest.push_back (std::make_tuple(i.second.second, i.second.first, i.first));
+	std::sort (hottest.rbegin(), hottest.rend());
+	printf ("%-32s %16s %16s\n", "function", "calls", "blocks");
+	for (int i = 0; i < hottest.size() && i < 10; ++i) {
+		printf ("%-32s %16llu %16llu\n", std::get<2>(hottest[i]).c_str(), std::get<1>(hottest[i]), std::get<0>(hottest[i]));
+	}
+	
+	std::vector<std::tuple<unsigned long long, std::string, int, unsigned long long>> hottest_loops;
+	for (auto& i: loops) hottest_loops.push_back (std::make_tuple(i.second.iterations, std::get<0>(i.first), std::get<1>(i.first), i.second.entries));
+	std::sort (hottest_loops.rbegin(), hottest_loops.rend());
+	if (!hottest_loops.empty()) {
+		printf ("\n%-32s %8s %16s %16s %12s\n", "loop", "line", "entries", "iterations", "average");
+		for (int i = 0; i < hottest_loops.size() && i < 10; ++i) {
+			unsigned long long entries = std::get<3>(hottest_loops[i]);
+			unsigned long long iterations = std::get<0>(hottest_loops[i]);
+			printf ("%-32s %8d %16llu %16llu %12.1f\n", std::get<1>(hottest_loops[i]).c_str(), std::get<2>(hottest_loops[i]), entries, iterations, entries > 0 ? (double)iterations / entries : 0.0);
+		}
+	}
+	
+	// the code inside functions and loops that were never entered is not listed separately
+	bool header = false;
+	for (const Counter& counter: counters) {
+		if (counter.count != 0) continue;
+		if (counter.kind != "function" && functions[counter.function].first == 0) continue;
+		if (counter.kind == "iteration" && loops[std::make_tuple(counter.function, counter.line)].entries == 0) continue;
+		if (!header) {
+			printf ("\n%-32s %8s %16s\n", "never executed", "line", "kind");
+			header = true;
+		}
+		printf ("%-32s %8d %16s\n", counter.function.c_str(), counter.line, counter.kind == "iteration" ? "loop body" : counter.kind.c_str());
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "server.hpp"
+#include "interface.hpp"
+#include <csignal>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A request consists of a message with the length of the payload and the
+// standard streams as SCM_RIGHTS, followed by the payload: the working
+// directory and the arguments, each terminated by '\0'. The response is the
+// exit status of the compilation.
+
+namespace {
+
+bool get_address (const char* path, sockaddr_un& address) {
+	memset (&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen (path) >= sizeof(address.sun_path)) {
+		fprintf (stderr, "error: socket path '%s' is too long\n", path);
+		return false;
+	}
+	strcpy (address.sun_path, path);
+	return true;
+}
+
+bool read_all (int fd, void* data, size_t size) {
+	char* bytes = (char*) data;
+	while (size > 0) {
+		ssize_t n = read (fd, bytes, size);
+		if (n <= 0) return false;
+		bytes += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool write_all (int fd, const void* data, size_t size) {
+	const char* bytes = (const char*) data;
+	while (size > 0) {
+		ssize_t n = write (fd, bytes, size);
+		if (n <= 0) return false;
+		bytes += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool send_header (int fd, uint32_t size, const int* fds, int count) {
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	memset (control, 0, sizeof(control));
+	iovec iov {&size, sizeof(size)};
+	msghdr message;
+	memset (&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+	cmsghdr* header = CMSG_FIRSTHDR (&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN (count * sizeof(int));
+	memcpy (CMSG_DATA(header), fds, count * sizeof(int));
+	return sendmsg (fd, &message, 0) == sizeof(size);
+}
+
+bool receive_header (int fd, uint32_t& size, int* fds, int count) {
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	iovec iov {&size, sizeof(size)};
+	msghdr message;
+	memset (&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	if (recvmsg (fd, &message, 0) != sizeof(size)) return false;
+	cmsghdr* header = CMSG_FIRSTHDR (&message);
+	if (!header || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(count * sizeof(int))) return false;
+	memcpy (fds, CMSG_DATA(header), count * sizeof(int));
+	return true;
+}
+
+// runs in a child of the server
+void handle (int connection, CompileFunction compile) {
+	int fds[3];
+	uint32_t size;
+	if (!receive_header (connection, size, fds, 3)) return;
+	std::string payload (size, '\0');
+	if (!read_all (connection, &payload[0], size)) return;
+	std::vector<char*> arguments;
+	for (size_t i = 0; i < payload.size(); i += strlen (&payload[i]) + 1) arguments.push_back (&payload[i]);
+	if (arguments.empty() || chdir (arguments[0]) != 0) return;
+	arguments[0] = (char*) "rea";
+	
+	// the compilation runs in its own process so that errors, which exit, can be reported
+	pid_t pid = fork ();
+	if (pid == 0) {
+		close (connection);
+		for (int i = 0; i < 3; ++i) {
+			dup2 (fds[i], i);
+			close (fds[i]);
+		}
+		int argc = arguments.size ();
+		arguments.push_back (nullptr);
+		exit (compile (argc, arguments.data()));
+	}
+	for (int i = 0; i < 3; ++i) close (fds[i]);
+	int status = EXIT_FAILURE;
+	if (pid > 0 && waitpid (pid, &status, 0) == pid) {
+		status = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+	}
+	write_all (connection, &status, sizeof(status));
+}
+
+}
+
+int serve (const char* path, int argc, char** argv, CompileFunction compile) {
+	// keep the interfaces of shared libraries warm
+	std::vector<Interface*> interfaces;
+	for (int i = 0; i < argc; ++i) {
+		if (strncmp (argv[i], "--interface=", 12) == 0) {
+			Interface* interface = Interface::load (argv[i] + 12);
+			if (!interface) return EXIT_FAILURE;
+			interfaces.push_back (interface);
+		}
+		else {
+			fprintf (stderr, "error: unknown server option '%s'\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	// the requests are forked from this process, so they find the symbols materialized
+	Interface::materialize (interfaces);
+	sockaddr_un address;
+	if (!get_address (path, address)) return EXIT_FAILURE;
+	int server = socket (AF_UNIX, SOCK_STREAM, 0);
+	unlink (path);
+	if (server < 0 || bind (server, (sockaddr*)&address, sizeof(address)) != 0 || listen (server, SOMAXCONN) != 0) {
+		fprintf (stderr, "error: cannot listen on '%s'\n", path);
+		return EXIT_FAILURE;
+	}
+	// finished requests are reaped automatically
+	signal (SIGCHLD, SIG_IGN);
+	while (true) {
+		int connection = accept (server, nullptr, nullptr);
+		if (connection < 0) continue;
+		fflush (nullptr);
+		pid_t pid = fork ();
+		if (pid == 0) {
+			close (server);
+			signal (SIGCHLD, SIG_DFL);
+			handle (connection, compile);
+			_exit (EXIT_SUCCESS);
+		}
+		close (connection);
+	}
+}
+
+bool forward (const char* path, int argc, char** argv, int& status) {
+	sockaddr_un address;
+	if (!get_address (path, address)) return false;
+	int connection = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0) return false;
+	if (connect (connection, (sockaddr*)&address, sizeof(address)) != 0) {
+		close (connection);
+		return false;
+	}
+	char* directory = getcwd (nullptr, 0);
+	std::string payload = directory ? directory : ".";
+	free (directory);
+	payload.push_back ('\0');
+	for (int i = 1; i < argc; ++i) {
+		payload.append (argv[i]);
+		payload.push_back ('\0');
+	}
+	const int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	if (!send_header (connection, payload.size(), fds, 3) || !write_all (connection, payload.data(), payload.size()) || !read_all (connection, &status, sizeof(status))) {
+		// the request might have been partially handled, so it is not repeated locally
+		fprintf (stderr, "error: the compile server did not respond\n");
+		status = EXIT_FAILURE;
+	}
+	close (connection);
+	return true;
+}
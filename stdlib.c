@@ -17,8 +17,139 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 void print (int32_t n) asm ("print.Int");
 void print (int32_t n) {
 	printf ("%d\n", n);
 }
+
+// instances that outlive their function are allocated from chunks that belong to the thread,
+// a region releases the chunks that were used since it was entered for the next allocations
+#define CHUNK_SIZE (64 * 1024)
+struct Chunk {
+	struct Chunk* previous;
+	size_t size;
+};
+static _Thread_local struct Chunk* chunk;
+static _Thread_local char* position;
+static _Thread_local char* end;
+static _Thread_local struct Chunk* spare_chunks;
+
+static __attribute__((noinline)) void* allocate_chunk (size_t size) {
+	struct Chunk* new_chunk;
+	if (spare_chunks && size <= CHUNK_SIZE - sizeof(struct Chunk)) {
+		new_chunk = spare_chunks;
+		spare_chunks = new_chunk->previous;
+	}
+	else {
+		// larger instances get a chunk of their own
+		const size_t chunk_size = size + sizeof(struct Chunk) > CHUNK_SIZE ? size + sizeof(struct Chunk) : CHUNK_SIZE;
+		new_chunk = malloc (chunk_size);
+		if (!new_chunk) {
+			fprintf (stderr, "error: out of memory\n");
+			abort ();
+		}
+		new_chunk->size = chunk_size;
+	}
+	new_chunk->previous = chunk;
+	chunk = new_chunk;
+	char* result = (char*)(new_chunk + 1);
+	position = result + size;
+	end = (char*)new_chunk + new_chunk->size;
+	return result;
+}
+
+void* allocate (int64_t size) asm ("rea.allocate");
+void* allocate (int64_t size) {
+	// instances are at most 8 byte aligned, empty instances still get their own address
+	size = size > 0 ? (size + 7) & ~7 : 8;
+	if (__builtin_expect (size > end - position, 0)) return allocate_chunk (size);
+	void* result = position;
+	position += size;
+	return result;
+}
+
+void* enter_region (void) asm ("rea.region.enter");
+void* enter_region (void) {
+	return position;
+}
+
+void leave_region (void* mark) asm ("rea.region.leave");
+void leave_region (void* mark) {
+	while (chunk && !((char*)mark > (char*)chunk && (char*)mark <= (char*)chunk + chunk->size)) {
+		struct Chunk* previous = chunk->previous;
+		if (chunk->size == CHUNK_SIZE) {
+			chunk->previous = spare_chunks;
+			spare_chunks = chunk;
+		}
+		else {
+			free (chunk);
+		}
+		chunk = previous;
+	}
+	position = mark;
+	end = chunk ? (char*)chunk + chunk->size : NULL;
+}
+
+// the accesses of arrays are checked against their length unless the index is known to be inside
+void index_error (int32_t index, int32_t length) asm ("rea.index_error");
+void index_error (int32_t index, int32_t length) {
+	fflush (stdout);
+	fprintf (stderr, "error: index %d is out of bounds for length %d\n", index, length);
+	exit (EXIT_FAILURE);
+}
+
+void length_error (int32_t length) asm ("rea.length_error");
+void length_error (int32_t length) {
+	fflush (stdout);
+	fprintf (stderr, "error: invalid array length %d\n", length);
+	exit (EXIT_FAILURE);
+}
+
+// the counters of programs that were compiled with --instrument
+struct Counter {
+	const char* kind;
+	int32_t line;
+};
+struct InstrumentedFunction {
+	const char* name;
+	const uint64_t* counts;
+	const struct Counter* counters;
+	int32_t size;
+};
+struct Instrumentation {
+	const struct InstrumentedFunction* functions;
+	int32_t size;
+	struct Instrumentation* next;
+};
+// the tables of all instrumented modules, every module registers its own
+static struct Instrumentation* instrumentations;
+
+// one line per counter: kind function line count
+static void write_profile (void) {
+	const char* path = getenv ("REA_PROFILE");
+	if (!path) path = "rea.profile";
+	FILE* file = fopen (path, "w");
+	if (!file) {
+		fprintf (stderr, "error: cannot open file '%s'\n", path);
+		return;
+	}
+	for (const struct Instrumentation* instrumentation = instrumentations; instrumentation; instrumentation = instrumentation->next) {
+		for (int32_t i = 0; i < instrumentation->size; ++i) {
+			const struct InstrumentedFunction* function = &instrumentation->functions[i];
+			for (int32_t j = 0; j < function->size; ++j) {
+				fprintf (file, "%s %s %d %llu\n", function->counters[j].kind, function->name, function->counters[j].line, (unsigned long long)function->counts[j]);
+			}
+		}
+	}
+	fclose (file);
+}
+
+// called by the constructors of the instrumented modules before main
+void register_counters (struct Instrumentation* instrumentation) asm ("rea.register_counters");
+void register_counters (struct Instrumentation* instrumentation) {
+	if (!instrumentations) atexit (write_profile);
+	instrumentation->next = instrumentations;
+	instrumentations = instrumentation;
+}
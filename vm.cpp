@@ -0,0 +1,748 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vm.hpp"
+#include "jit.hpp"
+#include "interface.hpp"
+#include <climits>
+
+namespace {
+
+const int CHUNK_SIZE = 4096;
+const int STACK_SIZE = 1 << 20;
+const int CALL_THRESHOLD = 1000;
+const int BACK_EDGE_THRESHOLD = 10000;
+
+void runtime_error (const char* message) {
+	fflush (stdout);
+	fprintf (stderr, "error: %s\n", message);
+	exit (EXIT_FAILURE);
+}
+
+// the same messages as the runtime in stdlib.c
+void array_error (const char* format, int32_t a, int32_t b = 0) {
+	char message[128];
+	snprintf (message, sizeof(message), format, a, b);
+	runtime_error (message);
+}
+
+void print_int (int32_t n) {
+	printf ("%d\n", n);
+}
+
+struct Native {
+	const char* name;
+	const ast::Type* arguments[4];
+	void* address;
+};
+
+const Native natives[] = {
+	{"print", {&ast::Type::INT}, (void*) print_int}
+};
+
+// Int and Bool arguments are both passed as 32 bit integers
+template <class R> R call_native (void* address, const vm::Value* arguments, int count) {
+	typedef int32_t I;
+	const vm::Value* a = arguments;
+	switch (count) {
+		case 0: return ((R (*) ()) address) ();
+		case 1: return ((R (*) (I)) address) (a[0].i);
+		case 2: return ((R (*) (I, I)) address) (a[0].i, a[1].i);
+		case 3: return ((R (*) (I, I, I)) address) (a[0].i, a[1].i, a[2].i);
+		case 4: return ((R (*) (I, I, I, I)) address) (a[0].i, a[1].i, a[2].i, a[3].i);
+		case 5: return ((R (*) (I, I, I, I, I)) address) (a[0].i, a[1].i, a[2].i, a[3].i, a[4].i);
+		default: return ((R (*) (I, I, I, I, I, I)) address) (a[0].i, a[1].i, a[2].i, a[3].i, a[4].i, a[5].i);
+	}
+}
+
+void call_native (const ast::FunctionDeclaration* declaration, void* address, vm::Value* registers) {
+	int count = 0;
+	while (declaration->get_argument(count)) ++count;
+	const ast::Type* return_type = declaration->get_return_type ();
+	if (return_type == &ast::Type::VOID) call_native<void> (address, registers, count);
+	// only the lowest bit of an i1 return value is defined
+	else if (return_type == &ast::Type::BOOL) registers[0].i = call_native<int32_t> (address, registers, count) & 1;
+	else registers[0].i = call_native<int32_t> (address, registers, count);
+}
+
+struct Operation {
+	const char* instruction;
+	vm::Opcode opcode;
+};
+
+const Operation operations[] = {
+	{"add", vm::ADD},
+	{"sub", vm::SUB},
+	{"mul", vm::MUL},
+	{"sdiv", vm::DIV},
+	{"srem", vm::MOD},
+	{"icmp eq", vm::EQ},
+	{"icmp ne", vm::NE},
+	{"icmp slt", vm::LT},
+	{"icmp sgt", vm::GT},
+	{"icmp sle", vm::LE},
+	{"icmp sge", vm::GE}
+};
+
+}
+
+// ast
+
+int ast::Number::compile (vm::Compiler& compiler) {
+	int result = compiler.allocate ();
+	compiler.emit (vm::LITERAL, result, n);
+	return result;
+}
+
+int ast::BooleanLiteral::compile (vm::Compiler& compiler) {
+	int result = compiler.allocate ();
+	compiler.emit (vm::LITERAL, result, value ? 1 : 0);
+	return result;
+}
+
+int ast::Variable::compile (vm::Compiler& compiler) {
+	return n;
+}
+void ast::Variable::compile_store (vm::Compiler& compiler, int source) {
+	compiler.emit (vm::MOVE, n, source);
+}
+
+int ast::Instantiation::compile (vm::Compiler& compiler) {
+	int result = compiler.allocate ();
+	compiler.emit (vm::NEW, result, attribute_values.size());
+	for (int i = 0; i < attribute_values.size(); ++i) {
+		compiler.emit (vm::SET, result, i, attribute_values[i]->compile(compiler));
+	}
+	return result;
+}
+
+int ast::AttributeAccess::compile (vm::Compiler& compiler) {
+	int object = expression->compile (compiler);
+	int index = expression->get_type()->get_class()->get_attribute(name)->get_n ();
+	int result = compiler.allocate ();
+	compiler.emit (vm::GET, result, object, index);
+	return result;
+}
+void ast::AttributeAccess::compile_store (vm::Compiler& compiler, int source) {
+	int object = expression->compile (compiler);
+	int index = expression->get_type()->get_class()->get_attribute(name)->get_n ();
+	compiler.emit (vm::SET, object, index, source);
+}
+
+// arrays are objects with the length in the first attribute, followed by the elements
+int ast::ArrayCreation::compile (vm::Compiler& compiler) {
+	int length_register = length->compile (compiler);
+	int result = compiler.allocate ();
+	compiler.emit (vm::NEW_ARRAY, result, length_register);
+	int value;
+	if (element->get_constant_value(value) && value == 0) return result;
+	// the element is evaluated again for every index
+	int index = compiler.allocate ();
+	int one = compiler.allocate ();
+	int condition = compiler.allocate ();
+	compiler.emit (vm::LITERAL, index, 0);
+	compiler.emit (vm::LITERAL, one, 1);
+	int check = compiler.get_position ();
+	compiler.emit (vm::LT, condition, index, length_register);
+	int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition);
+	compiler.emit (vm::STORE, result, index, element->compile(compiler));
+	compiler.emit (vm::ADD, index, index, one);
+	compiler.emit (vm::LOOP, check);
+	compiler.set_target (jump, compiler.get_position());
+	return result;
+}
+
+int ast::ArrayLiteral::compile (vm::Compiler& compiler) {
+	int result = compiler.allocate ();
+	int index = compiler.allocate ();
+	compiler.emit (vm::LITERAL, index, elements.size());
+	compiler.emit (vm::NEW_ARRAY, result, index);
+	for (int i = 0; i < elements.size(); ++i) {
+		int element = elements[i]->compile (compiler);
+		compiler.emit (vm::LITERAL, index, i);
+		compiler.emit (vm::STORE, result, index, element);
+	}
+	return result;
+}
+
+int ast::Index::compile (vm::Compiler& compiler) {
+	int array_register = array->compile (compiler);
+	int index_register = index->compile (compiler);
+	int result = compiler.allocate ();
+	compiler.emit (vm::LOAD, result, array_register, index_register);
+	return result;
+}
+void ast::Index::compile_store (vm::Compiler& compiler, int source) {
+	int array_register = array->compile (compiler);
+	int index_register = index->compile (compiler);
+	compiler.emit (vm::STORE, array_register, index_register, source);
+}
+
+// the interpreter stores the elements of arrays of soa classes as instances
+int ast::ColumnAccess::compile (vm::Compiler& compiler) {
+	int object = element->compile (compiler);
+	int index = element->get_type()->get_class()->get_attribute(name)->get_n ();
+	int result = compiler.allocate ();
+	compiler.emit (vm::GET, result, object, index);
+	return result;
+}
+void ast::ColumnAccess::compile_store (vm::Compiler& compiler, int source) {
+	int object = element->compile (compiler);
+	int index = element->get_type()->get_class()->get_attribute(name)->get_n ();
+	compiler.emit (vm::SET, object, index, source);
+}
+
+int ast::ArrayLength::compile (vm::Compiler& compiler) {
+	int array_register = array->compile (compiler);
+	int result = compiler.allocate ();
+	compiler.emit (vm::GET, result, array_register, 0);
+	return result;
+}
+
+int ast::Assignment::compile (vm::Compiler& compiler) {
+	int source = right->compile (compiler);
+	left->compile_store (compiler, source);
+	return source;
+}
+
+int ast::Call::compile (vm::Compiler& compiler) {
+	int function = compiler.get_function (this);
+	int base = compiler.allocate (arguments.empty() ? 1 : arguments.size());
+	for (int i = 0; i < arguments.size(); ++i) {
+		compiler.emit (vm::MOVE, base + i, arguments[i]->compile(compiler));
+	}
+	compiler.emit (compiler.is_native(function) ? vm::CALL_NATIVE : vm::CALL, base, function);
+	return base;
+}
+
+// vectors are arrays whose lanes are never changed, every operation creates a new one
+static int compile_vector (vm::Compiler& compiler, const ast::Type* type) {
+	int result = compiler.allocate ();
+	int lanes = compiler.allocate ();
+	compiler.emit (vm::LITERAL, lanes, type->get_vector()->get_lanes());
+	compiler.emit (vm::NEW_ARRAY, result, lanes);
+	return result;
+}
+
+// applies the operation to every pair of lanes
+static int compile_lanes (vm::Compiler& compiler, vm::Opcode opcode, const ast::Type* type, int left, int right) {
+	int result = compile_vector (compiler, type);
+	int left_lane = compiler.allocate ();
+	int right_lane = compiler.allocate ();
+	for (int i = 1; i <= type->get_vector()->get_lanes(); ++i) {
+		compiler.emit (vm::GET, left_lane, left, i);
+		compiler.emit (vm::GET, right_lane, right, i);
+		compiler.emit (opcode, left_lane, left_lane, right_lane);
+		compiler.emit (vm::SET, result, i, left_lane);
+	}
+	return result;
+}
+
+int ast::BinaryExpression::compile (vm::Compiler& compiler) {
+	int left_register = left->compile (compiler);
+	int right_register = right->compile (compiler);
+	for (const Operation& operation: operations) {
+		if (strcmp (operation.instruction, instruction) == 0) {
+			if (get_type()->get_vector()) return compile_lanes (compiler, operation.opcode, get_type(), left_register, right_register);
+			int result = compiler.allocate ();
+			compiler.emit (operation.opcode, result, left_register, right_register);
+			return result;
+		}
+	}
+	return compiler.allocate ();
+}
+
+// the lanes are 0 or 1, so their product is their conjunction and their sum is not 0 for their disjunction
+int ast::And::compile (vm::Compiler& compiler) {
+	if (get_type()->get_vector()) {
+		int left_register = left->compile (compiler);
+		int right_register = right->compile (compiler);
+		return compile_lanes (compiler, vm::MUL, get_type(), left_register, right_register);
+	}
+	int result = compiler.allocate ();
+	compiler.emit (vm::MOVE, result, left->compile(compiler));
+	int jump = compiler.emit (vm::JUMP_UNLESS, 0, result);
+	compiler.emit (vm::MOVE, result, right->compile(compiler));
+	compiler.set_target (jump, compiler.get_position());
+	return result;
+}
+
+int ast::Or::compile (vm::Compiler& compiler) {
+	if (const VectorType* type = get_type()->get_vector()) {
+		int left_register = left->compile (compiler);
+		int right_register = right->compile (compiler);
+		int result = compile_lanes (compiler, vm::ADD, type, left_register, right_register);
+		int lane = compiler.allocate ();
+		int zero = compiler.allocate ();
+		compiler.emit (vm::LITERAL, zero, 0);
+		for (int i = 1; i <= type->get_lanes(); ++i) {
+			compiler.emit (vm::GET, lane, result, i);
+			compiler.emit (vm::NE, lane, lane, zero);
+			compiler.emit (vm::SET, result, i, lane);
+		}
+		return result;
+	}
+	int result = compiler.allocate ();
+	compiler.emit (vm::MOVE, result, left->compile(compiler));
+	int jump = compiler.emit (vm::JUMP_IF, 0, result);
+	compiler.emit (vm::MOVE, result, right->compile(compiler));
+	compiler.set_target (jump, compiler.get_position());
+	return result;
+}
+
+int ast::VectorCreation::compile (vm::Compiler& compiler) {
+	int result = compile_vector (compiler, type);
+	if (lanes.size() == 1) {
+		int value = lanes[0]->compile (compiler);
+		for (int i = 1; i <= type->get_lanes(); ++i) compiler.emit (vm::SET, result, i, value);
+	}
+	else {
+		for (int i = 0; i < lanes.size(); ++i) compiler.emit (vm::SET, result, i + 1, lanes[i]->compile(compiler));
+	}
+	return result;
+}
+
+// constant lanes were checked by the parser, the others are checked like the elements of arrays
+int ast::Lane::compile (vm::Compiler& compiler) {
+	int vector_register = vector->compile (compiler);
+	int result = compiler.allocate ();
+	int value;
+	if (index->get_constant_value(value)) {
+		compiler.emit (vm::GET, result, vector_register, value + 1);
+	}
+	else {
+		compiler.emit (vm::LOAD, result, vector_register, index->compile(compiler));
+	}
+	return result;
+}
+void ast::Lane::compile_store (vm::Compiler& compiler, int source) {
+	// the vector is copied because other variables can refer to the same array
+	const VectorType* type = vector->get_type()->get_vector ();
+	int vector_register = vector->compile (compiler);
+	int copy = compile_vector (compiler, type);
+	int lane = compiler.allocate ();
+	for (int i = 1; i <= type->get_lanes(); ++i) {
+		compiler.emit (vm::GET, lane, vector_register, i);
+		compiler.emit (vm::SET, copy, i, lane);
+	}
+	int value;
+	if (index->get_constant_value(value)) {
+		compiler.emit (vm::SET, copy, value + 1, source);
+	}
+	else {
+		compiler.emit (vm::STORE, copy, index->compile(compiler), source);
+	}
+	vector->compile_store (compiler, copy);
+}
+
+int ast::Reduction::compile (vm::Compiler& compiler) {
+	int vector_register = vector->compile (compiler);
+	int result = compiler.allocate ();
+	int lane = compiler.allocate ();
+	int condition = compiler.allocate ();
+	compiler.emit (vm::GET, result, vector_register, 1);
+	for (int i = 2; i <= vector->get_type()->get_vector()->get_lanes(); ++i) {
+		compiler.emit (vm::GET, lane, vector_register, i);
+		if (strcmp (operation, "smin") == 0 || strcmp (operation, "smax") == 0) {
+			compiler.emit (strcmp (operation, "smin") == 0 ? vm::LT : vm::GT, condition, lane, result);
+			int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition);
+			compiler.emit (vm::MOVE, result, lane);
+			compiler.set_target (jump, compiler.get_position());
+		}
+		else {
+			compiler.emit (strcmp (operation, "and") == 0 ? vm::MUL : vm::ADD, result, result, lane);
+		}
+	}
+	if (strcmp (operation, "or") == 0) {
+		compiler.emit (vm::LITERAL, lane, 0);
+		compiler.emit (vm::NE, result, result, lane);
+	}
+	return result;
+}
+
+int ast::Shuffle::compile (vm::Compiler& compiler) {
+	int left_register = left->compile (compiler);
+	int right_register = right ? right->compile (compiler) : left_register;
+	int result = compile_vector (compiler, type);
+	int lane = compiler.allocate ();
+	const int lanes = left->get_type()->get_vector()->get_lanes ();
+	for (int i = 0; i < indices.size(); ++i) {
+		if (indices[i] < lanes) compiler.emit (vm::GET, lane, left_register, indices[i] + 1);
+		else compiler.emit (vm::GET, lane, right_register, indices[i] - lanes + 1);
+		compiler.emit (vm::SET, result, i + 1, lane);
+	}
+	return result;
+}
+
+int ast::Select::compile (vm::Compiler& compiler) {
+	int mask_register = mask->compile (compiler);
+	int left_register = left->compile (compiler);
+	int right_register = right->compile (compiler);
+	int result = compile_vector (compiler, get_type());
+	int lane = compiler.allocate ();
+	int condition = compiler.allocate ();
+	for (int i = 1; i <= get_type()->get_vector()->get_lanes(); ++i) {
+		compiler.emit (vm::GET, lane, right_register, i);
+		compiler.emit (vm::GET, condition, mask_register, i);
+		int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition);
+		compiler.emit (vm::GET, lane, left_register, i);
+		compiler.set_target (jump, compiler.get_position());
+		compiler.emit (vm::SET, result, i, lane);
+	}
+	return result;
+}
+
+void ast::ExpressionNode::compile (vm::Compiler& compiler) {
+	expression->compile (compiler);
+}
+
+void ast::If::compile (vm::Compiler& compiler) {
+	int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition->compile(compiler));
+	compiler.free_temporaries ();
+	if_block->compile (compiler);
+	compiler.set_target (jump, compiler.get_position());
+}
+
+void ast::While::compile (vm::Compiler& compiler) {
+	int checkwhile = compiler.get_position ();
+	int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition->compile(compiler));
+	compiler.free_temporaries ();
+	block->compile (compiler);
+	compiler.emit (vm::LOOP, checkwhile);
+	compiler.set_target (jump, compiler.get_position());
+}
+
+void ast::For::compile (vm::Compiler& compiler) {
+	if (array) {
+		compiler.emit (vm::MOVE, array->get_n(), expression->compile(compiler));
+		compiler.emit (vm::GET, end->get_n(), array->get_n(), 0);
+		compiler.emit (vm::LITERAL, index->get_n(), 0);
+	}
+	else {
+		compiler.emit (vm::MOVE, index->get_n(), start->compile(compiler));
+		compiler.emit (vm::MOVE, end->get_n(), expression->compile(compiler));
+	}
+	compiler.free_temporaries ();
+	int checkfor = compiler.get_position ();
+	int condition = compiler.allocate ();
+	compiler.emit (vm::LT, condition, index->get_n(), end->get_n());
+	int jump = compiler.emit (vm::JUMP_UNLESS, 0, condition);
+	compiler.free_temporaries ();
+	if (array) compiler.emit (vm::LOAD, variable->get_n(), array->get_n(), index->get_n());
+	block->compile (compiler);
+	int one = compiler.allocate ();
+	compiler.emit (vm::LITERAL, one, 1);
+	compiler.emit (vm::ADD, index->get_n(), index->get_n(), one);
+	compiler.free_temporaries ();
+	compiler.emit (vm::LOOP, checkfor);
+	compiler.set_target (jump, compiler.get_position());
+}
+
+// the interpreter does not free instances
+void ast::Region::compile (vm::Compiler& compiler) {
+	block->compile (compiler);
+}
+
+void ast::Return::compile (vm::Compiler& compiler) {
+	if (expression)
+		compiler.emit (vm::RETURN, expression->compile(compiler));
+	else
+		compiler.emit (vm::RETURN_VOID);
+}
+
+void ast::Function::compile (vm::Compiler& compiler) {
+	compiler.begin_function (this);
+	block->compile (compiler);
+	if (!block->returns) compiler.emit (vm::RETURN_VOID);
+}
+
+void ast::Block::compile (vm::Compiler& compiler) {
+	for (Node* node: nodes) {
+		node->compile (compiler);
+		compiler.free_temporaries ();
+	}
+}
+
+void ast::Program::compile (vm::Compiler& compiler) {
+	for (FunctionDeclaration* function_declaration: function_declarations) compiler.insert_function_declaration (function_declaration);
+	for (Interface* interface: interfaces) {
+		for (FunctionDeclaration* function_declaration: interface->get_function_declarations()) compiler.insert_function_declaration (function_declaration);
+	}
+	
+	for (Function* function: functions) compiler.insert_function (function);
+	
+	for (Function* function: functions) function->compile (compiler);
+}
+
+// Compiler
+
+void vm::Compiler::insert_function_declaration (ast::FunctionDeclaration* function_declaration) {
+	Function* function = new Function (function_declaration);
+	for (const Native& native: natives) {
+		if (!(function_declaration->get_name() == native.name)) continue;
+		bool match = true;
+		for (int i = 0; function_declaration->get_argument(i) || native.arguments[i]; ++i) {
+			if (function_declaration->get_argument(i) != native.arguments[i]) match = false;
+		}
+		if (match) function->address = native.address;
+	}
+	function->native = true;
+	if (!function->address) {
+		File (stderr).print ("error: no native implementation of '%'\n", function_declaration->get_mangled_name());
+		exit (EXIT_FAILURE);
+	}
+	program.add_function (function);
+}
+
+void vm::Compiler::insert_function (ast::Function* function) {
+	program.add_function (new Function(function));
+}
+
+void vm::Compiler::begin_function (ast::Function* function) {
+	this->function = program.get_function (program.get_function_index(function));
+	first_temporary = function->get_variable_count ();
+	next_temporary = first_temporary;
+	this->function->registers = first_temporary > 0 ? first_temporary : 1;
+}
+
+int vm::Compiler::allocate (int count) {
+	int result = next_temporary;
+	next_temporary += count;
+	if (next_temporary > function->registers) function->registers = next_temporary;
+	return result;
+}
+
+int vm::Compiler::emit (Opcode opcode, int a, int b, int c) {
+	Instruction instruction;
+	instruction.handler = nullptr;
+	instruction.opcode = opcode;
+	instruction.a = a;
+	instruction.b = b;
+	instruction.c = c;
+	function->code.push_back (instruction);
+	return function->code.size() - 1;
+}
+
+int vm::Compiler::get_function (const ast::FunctionPrototype* prototype) {
+	return program.get_function_index (ast_program->get_function(prototype));
+}
+
+// Program
+
+vm::Program::~Program () {
+	for (Value* chunk: chunks) delete[] chunk;
+	for (Function* function: functions) delete function;
+}
+
+int vm::Program::add_function (Function* function) {
+	indices[function->declaration] = functions.size ();
+	functions.push_back (function);
+	return functions.size() - 1;
+}
+
+int vm::Program::get_function_index (const ast::FunctionDeclaration* declaration) const {
+	return indices.find(declaration)->second;
+}
+
+vm::Function* vm::Program::get_main () const {
+	for (Function* function: functions) {
+		if (function->declaration->get_name() == "main" && !function->declaration->get_argument(0) && !function->native)
+			return function;
+	}
+	return nullptr;
+}
+
+// objects live until the program is destroyed
+vm::Value* vm::Program::allocate_object (int size) {
+	if (chunks.empty() || chunk_position + size > CHUNK_SIZE) {
+		chunks.push_back (new Value[size > CHUNK_SIZE ? size : CHUNK_SIZE]);
+		chunk_position = 0;
+	}
+	Value* result = chunks.back() + chunk_position;
+	chunk_position += size;
+	return result;
+}
+
+// replace every opcode with the address of its handler
+void vm::Program::thread (const void* const* labels) {
+	for (Function* function: functions) {
+		for (Instruction& instruction: function->code) {
+			instruction.handler = labels[instruction.opcode];
+		}
+	}
+	threaded = true;
+}
+
+void vm::Program::run (Function* function) {
+	static const void* const labels[OPCODE_COUNT] = {
+		&&op_literal,
+		&&op_move,
+		&&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod,
+		&&op_eq, &&op_ne, &&op_lt, &&op_gt, &&op_le, &&op_ge,
+		&&op_jump,
+		&&op_jump_if,
+		&&op_jump_unless,
+		&&op_loop,
+		&&op_call,
+		&&op_call_native,
+		&&op_return,
+		&&op_return_void,
+		&&op_new,
+		&&op_get,
+		&&op_set,
+		&&op_new_array,
+		&&op_load,
+		&&op_store
+	};
+	if (!threaded) thread (labels);
+	
+	struct Frame {
+		Function* function;
+		const Instruction* ip;
+		Value* registers;
+	};
+	std::vector<Frame> frames;
+	std::vector<Value> stack (STACK_SIZE);
+	const Value* stack_end = stack.data() + stack.size();
+	
+	Function* current = function;
+	Value* registers = stack.data ();
+	const Instruction* ip = current->code.data ();
+	
+	#define DISPATCH() goto *ip->handler
+	#define NEXT() ++ip; DISPATCH ()
+	#define BINARY(OPERATOR) registers[ip->a].i = (uint32_t)registers[ip->b].i OPERATOR (uint32_t)registers[ip->c].i; NEXT ()
+	#define COMPARISON(OPERATOR) registers[ip->a].i = registers[ip->b].i OPERATOR registers[ip->c].i; NEXT ()
+	
+	DISPATCH ();
+	
+	op_literal:
+	registers[ip->a].i = ip->b;
+	NEXT ();
+	
+	op_move:
+	registers[ip->a] = registers[ip->b];
+	NEXT ();
+	
+	op_add: BINARY (+);
+	op_sub: BINARY (-);
+	op_mul: BINARY (*);
+	op_div:
+	op_mod:
+	if (registers[ip->c].i == 0) runtime_error ("division by zero");
+	if (registers[ip->b].i == INT_MIN && registers[ip->c].i == -1) runtime_error ("division overflow");
+	if (ip->opcode == DIV) registers[ip->a].i = registers[ip->b].i / registers[ip->c].i;
+	else registers[ip->a].i = registers[ip->b].i % registers[ip->c].i;
+	NEXT ();
+	
+	op_eq: COMPARISON (==);
+	op_ne: COMPARISON (!=);
+	op_lt: COMPARISON (<);
+	op_gt: COMPARISON (>);
+	op_le: COMPARISON (<=);
+	op_ge: COMPARISON (>=);
+	
+	op_loop:
+	if (jit && current->back_edges < BACK_EDGE_THRESHOLD && ++current->back_edges == BACK_EDGE_THRESHOLD) jit->request (current);
+	op_jump:
+	ip = current->code.data() + ip->a;
+	DISPATCH ();
+	
+	op_jump_if:
+	if (registers[ip->b].i) ip = current->code.data() + ip->a;
+	else ++ip;
+	DISPATCH ();
+	
+	op_jump_unless:
+	if (!registers[ip->b].i) ip = current->code.data() + ip->a;
+	else ++ip;
+	DISPATCH ();
+	
+	op_call: {
+		Function* callee = functions[ip->b];
+		if (void* address = callee->address.load(std::memory_order_acquire)) {
+			call_native (callee->declaration, address, registers + ip->a);
+			NEXT ();
+		}
+		if (jit && callee->calls < CALL_THRESHOLD && ++callee->calls == CALL_THRESHOLD) jit->request (callee);
+		Value* callee_registers = registers + ip->a;
+		if (callee_registers + callee->registers > stack_end) runtime_error ("stack overflow");
+		frames.push_back (Frame {current, ip + 1, registers});
+		current = callee;
+		registers = callee_registers;
+		ip = current->code.data ();
+		DISPATCH ();
+	}
+	
+	op_call_native:
+	call_native (functions[ip->b]->declaration, functions[ip->b]->address.load(std::memory_order_relaxed), registers + ip->a);
+	NEXT ();
+	
+	op_return:
+	// the caller expects the result in the first register of the callee
+	registers[0] = registers[ip->a];
+	op_return_void:
+	if (frames.empty()) return;
+	current = frames.back().function;
+	ip = frames.back().ip;
+	registers = frames.back().registers;
+	frames.pop_back ();
+	DISPATCH ();
+	
+	op_new:
+	registers[ip->a].p = allocate_object (ip->b > 0 ? ip->b : 1);
+	NEXT ();
+	
+	op_get:
+	registers[ip->a] = registers[ip->b].p[ip->c];
+	NEXT ();
+	
+	op_set:
+	registers[ip->a].p[ip->b] = registers[ip->c];
+	NEXT ();
+	
+	op_new_array: {
+		const int32_t length = registers[ip->b].i;
+		if (length < 0) array_error ("invalid array length %d", length);
+		Value* array = allocate_object (length + 1);
+		array[0].i = length;
+		for (int32_t i = 1; i <= length; ++i) array[i].p = nullptr;
+		registers[ip->a].p = array;
+		NEXT ();
+	}
+	
+	op_load: {
+		const Value* array = registers[ip->b].p;
+		const int32_t index = registers[ip->c].i;
+		if ((uint32_t)index >= (uint32_t)array[0].i) array_error ("index %d is out of bounds for length %d", index, array[0].i);
+		registers[ip->a] = array[index + 1];
+		NEXT ();
+	}
+	
+	op_store: {
+		Value* array = registers[ip->a].p;
+		const int32_t index = registers[ip->b].i;
+		if ((uint32_t)index >= (uint32_t)array[0].i) array_error ("index %d is out of bounds for length %d", index, array[0].i);
+		array[index + 1] = registers[ip->c];
+		NEXT ();
+	}
+	
+	#undef DISPATCH
+	#undef NEXT
+	#undef BINARY
+	#undef COMPARISON
+}
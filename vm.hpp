@@ -0,0 +1,131 @@
+/*
+
+Copyright (c) 2015-2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "ast.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+
+namespace vm {
+
+union Value {
+	int32_t i;
+	Value* p;
+};
+
+enum Opcode {
+	LITERAL, // a = b
+	MOVE, // a = b
+	ADD, SUB, MUL, DIV, MOD, // a = b op c
+	EQ, NE, LT, GT, LE, GE, // a = b op c
+	JUMP, // goto a
+	JUMP_IF, // if b goto a
+	JUMP_UNLESS, // if !b goto a
+	LOOP, // goto a (back edge)
+	CALL, // a = function b (arguments starting at a)
+	CALL_NATIVE, // a = native code of function b (arguments starting at a)
+	RETURN, // return a
+	RETURN_VOID,
+	NEW, // a = new object with b attributes
+	GET, // a = b.attributes[c]
+	SET, // a.attributes[b] = c
+	NEW_ARRAY, // a = new array with b elements that are zero
+	LOAD, // a = b[c]
+	STORE, // a[b] = c
+	OPCODE_COUNT
+};
+
+struct Instruction {
+	const void* handler;
+	int opcode;
+	int a, b, c;
+};
+
+class Jit;
+
+class Function {
+public:
+	ast::FunctionDeclaration* declaration;
+	std::vector<Instruction> code;
+	int registers;
+	bool native;
+	// either a builtin or the code generated by the JIT
+	std::atomic<void*> address;
+	// counted up to the thresholds of the JIT, so they cannot overflow
+	int calls;
+	int back_edges;
+	Function (ast::FunctionDeclaration* declaration): declaration(declaration), registers(1), native(false), address(nullptr), calls(0), back_edges(0) {}
+};
+
+class Program {
+	std::vector<Function*> functions;
+	std::map<const ast::FunctionDeclaration*, int> indices;
+	std::vector<Value*> chunks;
+	int chunk_position;
+	bool threaded;
+	Jit* jit;
+	Value* allocate_object (int size);
+	void thread (const void* const* labels);
+public:
+	Program (): chunk_position(0), threaded(false), jit(nullptr) {}
+	~Program ();
+	int add_function (Function* function);
+	int get_function_index (const ast::FunctionDeclaration* declaration) const;
+	Function* get_function (int index) const {
+		return functions[index];
+	}
+	const std::vector<Function*>& get_functions () const {
+		return functions;
+	}
+	void set_jit (Jit* jit) {
+		this->jit = jit;
+	}
+	Function* get_main () const;
+	void run (Function* function);
+};
+
+class Compiler {
+	Program& program;
+	ast::Program* ast_program;
+	Function* function;
+	int first_temporary;
+	int next_temporary;
+public:
+	Compiler (Program& program, ast::Program* ast_program): program(program), ast_program(ast_program), function(nullptr), first_temporary(0), next_temporary(0) {}
+	void insert_function_declaration (ast::FunctionDeclaration* function_declaration);
+	void insert_function (ast::Function* function);
+	void begin_function (ast::Function* function);
+	int allocate (int count = 1);
+	void free_temporaries () {
+		next_temporary = first_temporary;
+	}
+	int emit (Opcode opcode, int a = 0, int b = 0, int c = 0);
+	int get_position () const {
+		return function->code.size ();
+	}
+	void set_target (int instruction, int position) {
+		function->code[instruction].a = position;
+	}
+	int get_function (const ast::FunctionPrototype* prototype);
+	bool is_native (int index) const {
+		return program.get_function(index)->native;
+	}
+};
+
+}
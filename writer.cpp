@@ -16,15 +16,35 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 */
 
 #include "writer.hpp"
+#include "escape.hpp"
+#include "cache.hpp"
+#include "interface.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <map>
+#include <unistd.h>
 
 const ast::Void ast::Type::VOID {};
 const ast::Bool ast::Type::BOOL {};
 const ast::Int ast::Type::INT {};
 
 void ast::FunctionPrototype::insert_mangled_name (File& file) {
-	file.print (get_name());
-	for (int i = 0; const Type* argument = get_argument(i); ++i)
-		file.print (".%", argument->get_name());
+	file.print ("%", writer::get_mangled_name(this).c_str());
+}
+
+std::string writer::get_mangled_name (const ast::FunctionPrototype* prototype) {
+	const Substring& name = prototype->get_name ();
+	std::string result (name.get_data(), name.get_length());
+	for (int i = 0; const ast::Type* argument = prototype->get_argument(i); ++i) {
+		Substring argument_name = argument->get_name ();
+		result += '.';
+		// the brackets of array types are not allowed in LLVM identifiers
+		for (int j = 0; j < argument_name.get_length(); ++j) {
+			const char c = argument_name.get_data()[j];
+			result += c == '[' || c == ']' ? '$' : c;
+		}
+	}
+	return result;
 }
 
 writer::Value* ast::Number::insert (Writer& writer) {
@@ -36,6 +56,7 @@ writer::Value* ast::BooleanLiteral::insert (Writer& writer) {
 }
 
 writer::Value* ast::Variable::insert (Writer& writer) {
+	if (!value) return writer.get_replaced_instance (this, type->get_class());
 	return writer.insert_load (value, type);
 }
 writer::Value* ast::Variable::insert_address (Writer& writer) {
@@ -43,12 +64,16 @@ writer::Value* ast::Variable::insert_address (Writer& writer) {
 }
 
 writer::Value* ast::Instantiation::insert (Writer& writer) {
-	writer::Value* result = writer.insert_alloca_value (_class);
+	writer::Value* result = writer.insert_instance (this, _class);
+	const bool initialized = writer.insert_defaults (result, _class);
 	for (int i = 0; i < attribute_values.size(); ++i) {
+		int value;
+		if (initialized && attribute_values[i] == _class->get_default_values()[i] && attribute_values[i]->get_constant_value(value)) continue;
 		writer::Value* destination = writer.insert_gep (result, _class, i);
 		writer::Value* source = attribute_values[i]->insert (writer);
 		writer.insert_store (destination, source, attribute_values[i]->get_type());
 	}
+	writer.end_instance ();
 	return result;
 }
 
@@ -62,10 +87,76 @@ writer::Value* ast::AttributeAccess::insert_address (Writer& writer) {
 	return writer.insert_gep (value, expression->get_type(), index);
 }
 
+writer::Value* ast::ArrayCreation::insert (Writer& writer) {
+	writer::Value* length_value = length->insert (writer);
+	int value;
+	if (type->has_columns()) {
+		// the columns start zeroed, the other default values are stored for every element
+		writer::Value* array = writer.insert_array (type, length_value, true);
+		const Class* _class = type->get_element_type()->get_class ();
+		for (Variable* attribute: _class->get_attributes()) {
+			Expression* default_value = _class->get_default_values()[attribute->get_n()];
+			if (default_value->get_constant_value(value) && value == 0) continue;
+			writer.insert_loop (length_value, [&] (writer::Value* index) {
+				writer::Value* address = writer.insert_column (array, type, index, attribute->get_n(), false);
+				writer.insert_store (address, default_value->insert(writer), attribute->get_type());
+			});
+		}
+		return array;
+	}
+	// the memory is cleared if every element is zero
+	const bool zero = element->get_constant_value(value) && value == 0;
+	writer::Value* array = writer.insert_array (type, length_value, zero);
+	if (!zero) {
+		writer.insert_loop (length_value, [&] (writer::Value* index) {
+			writer::Value* address = writer.insert_element (array, type, index, false);
+			writer.insert_store (address, element->insert(writer), type->get_element_type());
+		});
+	}
+	return array;
+}
+
+writer::Value* ast::ArrayLiteral::insert (Writer& writer) {
+	writer::Value* array = writer.insert_array (type, writer.insert_literal(elements.size()), false);
+	for (int i = 0; i < elements.size(); ++i) {
+		writer::Value* address = writer.insert_element (array, type, writer.insert_literal(i), false);
+		writer.insert_store (address, elements[i]->insert(writer), type->get_element_type());
+	}
+	return array;
+}
+
+writer::Value* ast::Index::insert (Writer& writer) {
+	writer::Value* address = insert_address (writer);
+	return writer.insert_load (address, get_type());
+}
+writer::Value* ast::Index::insert_address (Writer& writer) {
+	writer::Value* array_value = array->insert (writer);
+	writer::Value* index_value = index->insert (writer);
+	return writer.insert_element (array_value, array->get_type()->get_array(), index_value, checked);
+}
+
+writer::Value* ast::ColumnAccess::insert (Writer& writer) {
+	writer::Value* address = insert_address (writer);
+	return writer.insert_load (address, get_type());
+}
+writer::Value* ast::ColumnAccess::insert_address (Writer& writer) {
+	Expression* array = element->get_array ();
+	writer::Value* array_value = array->insert (writer);
+	writer::Value* index_value = element->get_index()->insert (writer);
+	int attribute = element->get_type()->get_class()->get_attribute(name)->get_n ();
+	return writer.insert_column (array_value, array->get_type()->get_array(), index_value, attribute, element->checked);
+}
+
+writer::Value* ast::ArrayLength::insert (Writer& writer) {
+	writer::Value* array_value = array->insert (writer);
+	return writer.insert_array_length (array_value, array->get_type()->get_array());
+}
+
 writer::Value* ast::Assignment::insert (Writer& writer) {
 	writer::Value* destination = left->insert_address (writer);
 	writer::Value* source = right->insert (writer);
-	writer.insert_store (destination, source, get_type());
+	// variables of replaced instances have no address
+	if (destination) writer.insert_store (destination, source, get_type());
 	return nullptr;
 }
 
@@ -80,19 +171,25 @@ writer::Value* ast::Call::insert (Writer& writer) {
 writer::Value* ast::BinaryExpression::insert (Writer& writer) {
 	writer::Value* left_value = left->insert (writer);
 	writer::Value* right_value = right->insert (writer);
-	return writer.insert_binary_operation (instruction, left_value, right_value);
+	return writer.insert_binary_operation (instruction, left_value, right_value, left->get_type());
 }
 
 writer::Value* ast::And::insert (Writer& writer) {
-	writer::Block* block0 = writer.get_current_block ();
+	if (get_type()->get_vector()) {
+		writer::Value* left_value = left->insert (writer);
+		writer::Value* right_value = right->insert (writer);
+		return writer.insert_binary_operation ("and", left_value, right_value, get_type());
+	}
 	writer::Block* block1 = writer.create_block ();
 	writer::Block* block2 = writer.create_block ();
 	
 	writer::Value* value0 = left->insert (writer);
+	writer::Block* block0 = writer.get_current_block ();
 	writer.insert_branch (block1, block2, value0);
 	
 	writer.insert_block (block1);
 	writer::Value* value1 = right->insert (writer);
+	block1 = writer.get_current_block ();
 	writer.insert_branch (block2);
 	
 	writer.insert_block (block2);
@@ -100,29 +197,70 @@ writer::Value* ast::And::insert (Writer& writer) {
 }
 
 writer::Value* ast::Or::insert (Writer& writer) {
-	writer::Block* block0 = writer.get_current_block ();
+	if (get_type()->get_vector()) {
+		writer::Value* left_value = left->insert (writer);
+		writer::Value* right_value = right->insert (writer);
+		return writer.insert_binary_operation ("or", left_value, right_value, get_type());
+	}
 	writer::Block* block1 = writer.create_block ();
 	writer::Block* block2 = writer.create_block ();
 	
 	writer::Value* value0 = left->insert (writer);
+	writer::Block* block0 = writer.get_current_block ();
 	writer.insert_branch (block2, block1, value0);
 	
 	writer.insert_block (block1);
 	writer::Value* value1 = right->insert (writer);
+	block1 = writer.get_current_block ();
 	writer.insert_branch (block2);
 	
 	writer.insert_block (block2);
 	return writer.insert_phi (&ast::Type::BOOL, value0, block0, value1, block1);
 }
 
+writer::Value* ast::VectorCreation::insert (Writer& writer) {
+	std::vector<writer::Value*> values;
+	for (Expression* lane: lanes) values.push_back (lane->insert(writer));
+	return writer.insert_vector (type, values);
+}
+
+writer::Value* ast::Lane::insert (Writer& writer) {
+	writer::Value* vector_value = vector->insert (writer);
+	writer::Value* index_value = index->insert (writer);
+	return writer.insert_lane (vector_value, vector->get_type()->get_vector(), index_value, checked);
+}
+writer::Value* ast::Lane::insert_address (Writer& writer) {
+	writer::Value* address = vector->insert_address (writer);
+	writer::Value* index_value = index->insert (writer);
+	return writer.insert_lane_address (address, vector->get_type()->get_vector(), index_value, checked);
+}
+
+writer::Value* ast::Reduction::insert (Writer& writer) {
+	writer::Value* vector_value = vector->insert (writer);
+	return writer.insert_reduction (operation, vector_value, vector->get_type()->get_vector());
+}
+
+writer::Value* ast::Shuffle::insert (Writer& writer) {
+	writer::Value* left_value = left->insert (writer);
+	writer::Value* right_value = right ? right->insert (writer) : nullptr;
+	return writer.insert_shuffle (left_value, right_value, left->get_type()->get_vector(), indices);
+}
+
+writer::Value* ast::Select::insert (Writer& writer) {
+	writer::Value* mask_value = mask->insert (writer);
+	writer::Value* left_value = left->insert (writer);
+	writer::Value* right_value = right->insert (writer);
+	return writer.insert_select (mask_value, left_value, right_value, left->get_type());
+}
+
 void ast::If::write (Writer& writer) {
 	writer::Block* _if = writer.create_block ();
 	writer::Block* _endif = writer.create_block ();
 	
 	writer::Value* _c = condition->insert (writer);
-	writer.insert_branch (_if, _endif, _c);
+	writer.insert_branch (_if, _endif, _c, likelihood);
 	
-	writer.insert_block (_if);
+	writer.insert_block (_if, "if", line);
 	if_block->write (writer);
 	if (!if_block->returns) writer.insert_branch (_endif);
 	
@@ -134,19 +272,71 @@ void ast::While::write (Writer& writer) {
 	writer::Block* _while = writer.create_block ();
 	writer::Block* endwhile = writer.create_block ();
 	
+	// the loop is entered once per count, its body is executed once per iteration
+	writer.insert_counter ("loop", line);
 	writer.insert_branch (checkwhile);
 	
 	writer.insert_block (checkwhile);
 	writer::Value* _c = condition->insert (writer);
-	writer.insert_branch (_while, endwhile, _c);
+	writer.insert_branch (_while, endwhile, _c, likelihood);
 	
-	writer.insert_block (_while);
+	writer.insert_block (_while, "iteration", line);
 	block->write (writer);
 	if (!block->returns) writer.insert_branch (checkwhile);
 	
 	writer.insert_block (endwhile);
 }
 
+// the end and the array are evaluated once before the first iteration
+void ast::For::write (Writer& writer) {
+	writer::Block* checkfor = writer.create_block ();
+	writer::Block* _for = writer.create_block ();
+	writer::Block* endfor = writer.create_block ();
+	
+	const ArrayType* array_type = expression->get_type()->get_array ();
+	if (array_type) {
+		writer::Value* array_value = expression->insert (writer);
+		writer.insert_store (array->value, array_value, array_type);
+		writer.insert_store (end->value, writer.insert_array_length(array_value, array_type), &Type::INT);
+		writer.insert_store (index->value, writer.insert_literal(0), &Type::INT);
+	}
+	else {
+		writer.insert_store (index->value, start->insert(writer), &Type::INT);
+		writer.insert_store (end->value, expression->insert(writer), &Type::INT);
+	}
+	writer.insert_counter ("loop", line);
+	writer.insert_branch (checkfor);
+	
+	writer.insert_block (checkfor);
+	writer::Value* index_value = writer.insert_load (index->value, &Type::INT);
+	writer::Value* end_value = writer.insert_load (end->value, &Type::INT);
+	writer::Value* condition = writer.insert_binary_operation ("icmp slt", index_value, end_value);
+	writer.insert_branch (_for, endfor, condition);
+	
+	writer.insert_block (_for, "iteration", line);
+	if (array_type) {
+		// the index is always inside the bounds
+		writer::Value* array_value = writer.insert_load (array->value, array_type);
+		writer::Value* address = writer.insert_element (array_value, array_type, index_value, false);
+		writer.insert_store (variable->value, writer.insert_load(address, variable->get_type()), variable->get_type());
+	}
+	block->write (writer);
+	if (!block->returns) {
+		writer::Value* next = writer.insert_binary_operation ("add", writer.insert_load(index->value, &Type::INT), writer.insert_literal(1));
+		writer.insert_store (index->value, next, &Type::INT);
+		writer.insert_branch (checkfor);
+	}
+	
+	writer.insert_block (endfor);
+}
+
+void ast::Region::write (Writer& writer) {
+	writer.insert_region ();
+	block->write (writer);
+	// a return in the block already released the region
+	writer.end_region (!block->returns);
+}
+
 void ast::Return::write (Writer& writer) {
 	if (expression)
 		writer.insert_return (expression->insert(writer), expression->get_type());
@@ -155,29 +345,57 @@ void ast::Return::write (Writer& writer) {
 }
 
 void ast::Function::write (Writer& writer) {
+	EscapeAnalysis escape_analysis (this);
+	writer.set_line (line);
 	std::vector<writer::Value*> argument_values = writer.insert_function (this);
-	for (Variable* variable: variables) {
-		variable->value = writer.insert_alloca (variable->get_type());
+	writer.set_escape_analysis (&escape_analysis);
+	for (int i = 0; i < variables.size(); ++i) {
+		if (escape_analysis.get_replaced_instance(variables[i]) >= 0) {
+			variables[i]->value = nullptr;
+			continue;
+		}
+		variables[i]->value = writer.insert_alloca (variables[i]->get_type());
+		// the arguments are the first variables
+		writer.insert_variable_declaration (variables[i], i < arguments.size() ? i + 1 : 0);
 	}
 	for (int i = 0; i < arguments.size(); ++i) {
 		writer.insert_store (arguments[i]->value, argument_values[i], arguments[i]->get_type());
 	}
 	block->write (writer);
 	if (!block->returns) writer.insert_return ();
+	writer.set_escape_analysis (nullptr);
 }
 
 void ast::Block::write (Writer& writer) {
 	for (Node* node: nodes) {
+		writer.set_line (node->line);
 		node->write (writer);
 	}
 }
 
-void ast::Program::write (Writer& writer) {
+void ast::Program::write (Writer& writer, int jobs, Cache* cache) {
 	for (FunctionDeclaration* function_declaration: function_declarations) writer.insert_function_declaration (function_declaration);
+	for (Interface* interface: interfaces) {
+		for (FunctionDeclaration* function_declaration: interface->get_function_declarations()) writer.insert_function_declaration (function_declaration);
+	}
 	
 	for (Class* _class: classes) writer.insert_class (_class);
+	for (Interface* interface: interfaces) {
+		for (Class* _class: interface->get_classes()) writer.insert_class (_class);
+	}
 	
-	for (Function* function: functions) function->write (writer);
+	// every function gets its own writer so they can be generated in parallel
+	std::vector<writer::Function*> results (functions.size());
+	parallel_for (jobs, functions.size(), [&] (int i) {
+		if (cache && (results[i] = cache->get_function(functions[i]))) return;
+		profile::Scope scope ("codegen", profile::enabled ? writer::get_mangled_name(functions[i]) : std::string());
+		Writer function_writer (writer, i);
+		functions[i]->write (function_writer);
+		results[i] = function_writer.get_function ();
+		if (jobs > 1 || cache) results[i]->render ();
+		if (cache) cache->store (results[i]);
+	});
+	for (writer::Function* function: results) writer.append_function (function);
 }
 
 // writer
@@ -194,30 +412,259 @@ template <class F> writer::Instruction* make_instruction (const F& f) {
 	return new LambdaInstruction (f);
 }
 
-writer::Type* writer::get_type (const ast::Type* type) {
-	class PrimitiveType: public writer::Type {
-		const char* name;
-	public:
-		PrimitiveType (const char* name): name(name) {}
-		void print (File& file) const override {
-			file.print (name);
+namespace {
+
+class PrimitiveType: public writer::Type {
+	const char* name;
+public:
+	PrimitiveType (const char* name): name(name) {}
+	void print (File& file) const override {
+		file.print (name);
+	}
+};
+
+class ClassType: public writer::Type {
+	Substring name;
+public:
+	// the number of the DICompositeType metadata
+	int metadata;
+	writer::Layout layout;
+	ClassType (const Substring& name): name(name), metadata(0) {}
+	void print (File& file) const override {
+		file.print ("%%%*", name);
+	}
+};
+
+// the length of an array followed by its elements or by the columns of a soa class
+class ArrayStructType: public Printable {
+	const ast::ArrayType* type;
+public:
+	ArrayStructType (const ast::ArrayType* type): type(type) {}
+	void print (File& file) const override {
+		if (type->has_columns()) {
+			file.print ("{ i32");
+			for (ast::Variable* attribute: type->get_element_type()->get_class()->get_attributes())
+				file.print (", %*", writer::get_type(attribute->get_type()));
+			file.print (" }");
 		}
-	};
-	class ClassType: public writer::Type {
+		else {
+			file.print ("{ i32, [0 x %] }", writer::get_type(type->get_element_type()));
+		}
+	}
+};
+
+// vectors are values like <4 x i32>
+class VectorValueType: public writer::Type {
+	const ast::VectorType* type;
+public:
+	VectorValueType (const ast::VectorType* type): type(type) {}
+	void print (File& file) const override {
+		file.print ("<% x %>", type->get_lanes(), writer::get_type(type->get_element_type()));
+	}
+};
+
+class ArrayPointerType: public writer::Type {
+	const ast::ArrayType* type;
+public:
+	ArrayPointerType (const ast::ArrayType* type): type(type) {}
+	void print (File& file) const override {
+		file.print ("%*", ArrayStructType(type));
+	}
+};
+
+// the numbers of the fixed metadata nodes, followed by the classes and then the functions
+const int COMPILE_UNIT = 0;
+const int SOURCE_FILE = 1;
+const int DEBUG_INFO_VERSION = 2;
+const int DWARF_VERSION = 3;
+const int INT_TYPE = 4;
+const int BOOL_TYPE = 5;
+const int FIRST_METADATA = 6;
+
+// classes are passed as pointers
+class DebugType: public Printable {
+	const ast::Type* type;
+public:
+	DebugType (const ast::Type* type): type(type) {}
+	void print (File& file) const override {
+		if (type == &ast::Type::VOID) file.print ("null");
+		else if (type == &ast::Type::BOOL) file.print ("!%", BOOL_TYPE);
+		else if (type == &ast::Type::INT) file.print ("!%", INT_TYPE);
+		else if (type->get_array()) file.print ("!DIDerivedType(tag: DW_TAG_pointer_type, baseType: null, size: 64)");
+		else if (const ast::VectorType* vector_type = type->get_vector()) {
+			int size, alignment;
+			writer::get_layout (type, size, alignment);
+			file.print ("!DICompositeType(tag: DW_TAG_array_type, baseType: %, size: %, flags: DIFlagVector, elements: !{!DISubrange(count: %)})", DebugType(vector_type->get_element_type()), size * 8, vector_type->get_lanes());
+		}
+		else file.print ("!DIDerivedType(tag: DW_TAG_pointer_type, baseType: !%, size: 64)", static_cast<ClassType*>(type->type)->metadata);
+	}
+};
+
+class MetadataString: public Printable {
+	Substring s;
+public:
+	MetadataString (const Substring& s): s(s) {}
+	void print (File& file) const override {
+		file.print ('"');
+		for (int i = 0; i < s.get_length(); ++i) {
+			const unsigned char c = s.get_data()[i];
+			if (c == '"' || c == '\\' || c < ' ' || c > '~') {
+				char escaped[4];
+				snprintf (escaped, sizeof(escaped), "\\%02X", c);
+				file.print (escaped);
+			}
+			else {
+				file.print ((char)c);
+			}
+		}
+		file.print ('"');
+	}
+};
+
+}
+
+// the type cache of classes is only written by Writer::insert_class, so lookups are safe from
+// any thread, array and vector types are created on first use
+writer::Type* writer::get_type (const ast::Type* type) {
+	static PrimitiveType void_type ("void");
+	static PrimitiveType bool_type ("i1");
+	static PrimitiveType int_type ("i32");
+	if (type == &ast::Type::VOID) return &void_type;
+	if (type == &ast::Type::BOOL) return &bool_type;
+	if (type == &ast::Type::INT) return &int_type;
+	if (const ast::ArrayType* array_type = type->get_array()) {
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock (mutex);
+		if (!type->type) type->type = new ArrayPointerType (array_type);
+	}
+	if (const ast::VectorType* vector_type = type->get_vector()) {
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock (mutex);
+		if (!type->type) type->type = new VectorValueType (vector_type);
+	}
+	return type->type;
+}
+
+writer::Type* writer::get_value_type (const ast::Class* _class) {
+	class ValueType: public writer::Type {
 		Substring name;
 	public:
-		ClassType (const Substring& name): name(name) {}
+		ValueType (const Substring& name): name(name) {}
 		void print (File& file) const override {
-			file.print ("%%%*", name);
+			file.print ("%%%", name);
 		}
 	};
-	if (type->type == nullptr) {
-		if (type == &ast::Type::VOID) type->type = new PrimitiveType ("void");
-		else if (type == &ast::Type::BOOL) type->type = new PrimitiveType ("i1");
-		else if (type == &ast::Type::INT) type->type = new PrimitiveType ("i32");
-		else if (const ast::Class* _class = type->get_class()) type->type = new ClassType (_class->get_name());
+	return new ValueType (_class->get_name());
+}
+
+void writer::get_layout (const ast::Type* type, int& size, int& alignment) {
+	if (type == &ast::Type::INT) size = alignment = 4;
+	else if (type == &ast::Type::BOOL) size = alignment = 1;
+	// vectors of Int are aligned to their size, vectors of Bool fit into a byte
+	else if (const ast::VectorType* vector_type = type->get_vector()) size = alignment = vector_type->get_element_type() == &ast::Type::INT ? vector_type->get_lanes() * 4 : 1;
+	else size = alignment = 8;
+}
+
+const writer::Layout& writer::get_layout (const ast::Class* _class) {
+	return static_cast<ClassType*>(_class->type)->layout;
+}
+
+// the fields are in declaration order and aligned naturally as in the default data layout,
+// an optimized layout sorts them by alignment so that they need no padding in between
+static writer::Layout create_layout (const ast::Class* _class, bool optimize) {
+	writer::Layout layout;
+	const std::vector<ast::Variable*>& attributes = _class->get_attributes ();
+	int bools = 0;
+	for (ast::Variable* attribute: attributes) {
+		if (attribute->get_type() == &ast::Type::BOOL) ++bools;
 	}
-	return type->type;
+	// a single Bool gains nothing from sharing its byte
+	const bool pack_bools = _class->packed || (optimize && bools > 1);
+	std::vector<int> order;
+	for (int i = 0; i < attributes.size(); ++i) {
+		if (!pack_bools || attributes[i]->get_type() != &ast::Type::BOOL) order.push_back (i);
+	}
+	if (optimize) {
+		std::stable_sort (order.begin(), order.end(), [&] (int a, int b) {
+			int size_a, alignment_a, size_b, alignment_b;
+			writer::get_layout (attributes[a]->get_type(), size_a, alignment_a);
+			writer::get_layout (attributes[b]->get_type(), size_b, alignment_b);
+			return alignment_a > alignment_b;
+		});
+	}
+	layout.attribute_fields.assign (attributes.size(), -1);
+	layout.attribute_bits.assign (attributes.size(), -1);
+	for (int i: order) {
+		layout.attribute_fields[i] = layout.fields.size ();
+		layout.fields.push_back (attributes[i]->get_type());
+	}
+	if (pack_bools) {
+		int bit = 8;
+		for (int i = 0; i < attributes.size(); ++i) {
+			if (attributes[i]->get_type() != &ast::Type::BOOL) continue;
+			if (bit == 8) {
+				layout.fields.push_back (nullptr);
+				bit = 0;
+			}
+			layout.attribute_fields[i] = layout.fields.size () - 1;
+			layout.attribute_bits[i] = bit++;
+		}
+	}
+	layout.packed = _class->packed;
+	layout.size = 0;
+	layout.alignment = 1;
+	for (const ast::Type* type: layout.fields) {
+		int size = 1, alignment = 1;
+		if (type) writer::get_layout (type, size, alignment);
+		if (layout.packed) alignment = 1;
+		layout.size = (layout.size + alignment - 1) / alignment * alignment;
+		layout.offsets.push_back (layout.size);
+		layout.size += size;
+		layout.alignment = std::max (layout.alignment, alignment);
+	}
+	layout.size = (layout.size + layout.alignment - 1) / layout.alignment * layout.alignment;
+	return layout;
+}
+
+class FieldType: public Printable {
+	const ast::Type* type;
+public:
+	FieldType (const ast::Type* type): type(type) {}
+	void print (File& file) const override {
+		if (type) file.print (writer::get_type(type));
+		else file.print ("i8");
+	}
+};
+
+// the number of bytes behind a pointer to an instance, which is never null
+// unless the instance is empty and was allocated with malloc
+static int get_dereferenceable_size (const ast::Type* type) {
+	const ast::Class* _class = type->get_class ();
+	if (!_class) return 0;
+	return writer::get_layout(_class).size;
+}
+
+// functions that return instances take a slot for the result as their first argument,
+// the slot is null if the caller needs the result on the heap
+static void write_signature (File& file, ast::FunctionDeclaration* function, bool definition) {
+	const ast::Type* return_type = function->get_return_type ();
+	const int result_size = get_dereferenceable_size (return_type);
+	if (result_size > 0) file.print ("nonnull dereferenceable(%) ", result_size);
+	file.print ("% @%(", writer::get_type(return_type), function->get_mangled_name());
+	bool first = true;
+	if (return_type->get_class()) {
+		file.print ("% noalias", writer::get_type(return_type));
+		if (result_size > 0) file.print (" dereferenceable_or_null(%)", result_size);
+		if (definition) file.print (" %result");
+		first = false;
+	}
+	for (int i = 0; const ast::Type* argument = function->get_argument(i); ++i) {
+		if (!first) file.print (", ");
+		file.print (writer::get_type(argument));
+		if (int size = get_dereferenceable_size(argument)) file.print (" nonnull dereferenceable(%)", size);
+		first = false;
+	}
+	file.print (")");
 }
 
 void writer::Block::write (File& file) {
@@ -227,23 +674,56 @@ void writer::Block::write (File& file) {
 	}
 }
 
+// print the function into memory so it can be written out later
+void writer::Function::render () {
+	size = get_size ();
+	char* buffer;
+	size_t size;
+	FILE* stream = open_memstream (&buffer, &size);
+	File file (stream);
+	write (file);
+	fclose (stream);
+	text = buffer;
+	length = size;
+}
+
 void writer::Function::write (File& file) {
-	file.print ("define % @%(", writer::get_type(function->get_return_type()), function->get_mangled_name());
-	if (const ast::Type* argument = function->get_argument(0)) {
-		file.print (writer::get_type(argument));
-		for (int i = 1; const ast::Type* argument = function->get_argument(i); ++i) {
-			file.print (", %", writer::get_type(argument));
-		}
+	if (text) {
+		file.print (Substring(text, length));
+		return;
 	}
-	file.print (") nounwind {\n");
+	file.print ("define ");
+	write_signature (file, function, true);
+	file.print (function->cold ? " nounwind cold" : " nounwind");
+	if (debug_info != NO_DEBUG_INFO) file.print (" !dbg !%", subprogram);
+	file.print (" {\n");
 	for (writer::Block* block: blocks) {
 		block->write (file);
 	}
 	file.print ("}\n\n");
+	if (debug_info == NO_DEBUG_INFO) return;
+	file.print ("!% = distinct !DISubprogram(name: \"%\", linkageName: \"%\", scope: !%, file: !%, line: %, type: !DISubroutineType(types: !{", subprogram, function->get_name(), function->get_mangled_name(), SOURCE_FILE, SOURCE_FILE, function->line);
+	if (debug_info == FULL_DEBUG_INFO) {
+		file.print (DebugType(function->get_return_type()));
+		for (int i = 0; const ast::Type* argument = function->get_argument(i); ++i) {
+			file.print (", %", DebugType(argument));
+		}
+	}
+	file.print ("}), scopeLine: %, spFlags: DISPFlagDefinition, unit: !%)\n\n", function->line, COMPILE_UNIT);
 }
 
 // Writer
 
+Writer::Writer (const Writer& parent, int index): n(0), instrument(parent.instrument), optimize_layout(parent.optimize_layout), debug_info(parent.debug_info), source_name(parent.source_name), subprogram(FIRST_METADATA + parent.classes.size() + index), line(0), escape_analysis(nullptr) {}
+
+writer::Instruction* Writer::add_location (writer::Instruction* instruction) {
+	const int line = this->line;
+	const int scope = subprogram;
+	return make_instruction ([=] (File& file) {
+		file.print ("%, !dbg !DILocation(line: %, scope: !%)", instruction, line, scope);
+	});
+}
+
 writer::Value* Writer::insert_literal (int n) {
 	class LiteralValue: public writer::Value {
 		int n;
@@ -256,19 +736,135 @@ writer::Value* Writer::insert_literal (int n) {
 	return new LiteralValue (n);
 }
 
+writer::Value* Writer::insert_null () {
+	class NullValue: public writer::Value {
+	public:
+		void print (File& file) const override {
+			file.print ("null");
+		}
+	};
+	return new NullValue ();
+}
+
+// the mask of a packed Bool attribute as a signed i8
+static int get_mask (int bit) {
+	return (signed char)(1 << bit);
+}
+
+// instances and arrays on the heap are only 8 byte aligned, so vectors are accessed
+// with the alignment of their lanes
+static int get_alignment (writer::Value* value, const ast::Type* type) {
+	const int alignment = value->get_alignment ();
+	if (alignment) return alignment;
+	if (const ast::VectorType* vector_type = type->get_vector()) {
+		int lane_size, lane_alignment;
+		writer::get_layout (vector_type->get_element_type(), lane_size, lane_alignment);
+		return lane_alignment;
+	}
+	return 0;
+}
+
+namespace {
+
+// the address of a vector and one of its lanes
+class LaneAddress: public writer::Value {
+	writer::Value* address;
+	const ast::VectorType* type;
+	writer::Value* lane;
+public:
+	LaneAddress (writer::Value* address, const ast::VectorType* type, writer::Value* lane): address(address), type(type), lane(lane) {}
+	writer::Value* get_lane () const override {
+		return lane;
+	}
+	writer::Value* get_address () const {
+		return address;
+	}
+	const ast::VectorType* get_vector_type () const {
+		return type;
+	}
+	void print (File& file) const override {
+		file.print (address);
+	}
+};
+
+}
+
 writer::Value* Writer::insert_load (writer::Value* value, const ast::Type* _type) {
+	const int bit = value->get_bit ();
+	if (bit >= 0) {
+		writer::Value* byte = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = load i8, i8* %", byte, value);
+		}));
+		writer::Value* masked = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = and i8 %, %", masked, byte, get_mask(bit));
+		}));
+		writer::Value* destination = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = icmp ne i8 %, 0", destination, masked);
+		}));
+		return destination;
+	}
 	writer::Value* destination = next_value ();
 	const writer::Type* type = writer::get_type (_type);
+	const int alignment = get_alignment (value, _type);
 	insert_instruction (make_instruction([=] (File& file) {
-		file.print ("% = load %* %", destination, type, value);
+		file.print ("% = load %, %* %", destination, type, type, value);
+		if (alignment) file.print (", align %", alignment);
 	}));
 	return destination;
 }
 
 void Writer::insert_store (writer::Value* destination, writer::Value* source, const ast::Type* _type) {
+	const int bit = destination->get_bit ();
+	if (bit >= 0) {
+		// the other bits of the byte are kept
+		writer::Value* byte = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = load i8, i8* %", byte, destination);
+		}));
+		writer::Value* cleared = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = and i8 %, %", cleared, byte, ~get_mask(bit));
+		}));
+		writer::Value* extended = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = zext i1 % to i8", extended, source);
+		}));
+		writer::Value* shifted = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = shl i8 %, %", shifted, extended, bit);
+		}));
+		writer::Value* merged = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = or i8 %, %", merged, cleared, shifted);
+		}));
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("store i8 %, i8* %", merged, destination);
+		}));
+		return;
+	}
+	if (writer::Value* lane = destination->get_lane()) {
+		// the other lanes are kept
+		const LaneAddress* lane_address = static_cast<const LaneAddress*> (destination);
+		writer::Value* address = lane_address->get_address ();
+		const ast::VectorType* vector_type = lane_address->get_vector_type ();
+		writer::Value* vector = insert_load (address, vector_type);
+		writer::Value* result = next_value ();
+		const writer::Type* type = writer::get_type (vector_type);
+		const writer::Type* element_type = writer::get_type (_type);
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = insertelement % %, % %, i32 %", result, type, vector, element_type, source, lane);
+		}));
+		insert_store (address, result, vector_type);
+		return;
+	}
 	const writer::Type* type = writer::get_type (_type);
+	const int alignment = get_alignment (destination, _type);
 	insert_instruction (make_instruction([=] (File& file) {
 		file.print ("store % %, %* %", type, source, type, destination);
+		if (alignment) file.print (", align %", alignment);
 	}));
 }
 
@@ -284,19 +880,547 @@ writer::Value* Writer::insert_alloca (const ast::Type* type) {
 	return insert_alloca (writer::get_type(type));
 }
 
-writer::Value* Writer::insert_alloca_value (const ast::Class* _class) {
-	class ValueType: public writer::Type {
-		Substring name;
+writer::Value* Writer::get_instance_slot (int slot, const ast::Class* _class) {
+	class InstanceValue: public writer::Value {
+		int index;
 	public:
-		ValueType (const Substring& name): name(name) {}
+		InstanceValue (int index): index(index) {}
 		void print (File& file) const override {
-			file.print ("%%%", name);
+			file.print ("%%instance.%", index);
+		}
+	};
+	class AttributeValue: public writer::Value {
+		int index;
+		int attribute;
+	public:
+		AttributeValue (int index, int attribute): index(index), attribute(attribute) {}
+		void print (File& file) const override {
+			file.print ("%%instance.%.%", index, attribute);
 		}
 	};
-	return insert_alloca (new ValueType(_class->get_name()));
+	class ReplacedInstanceValue: public writer::Value {
+		std::vector<writer::Value*> attributes;
+	public:
+		ReplacedInstanceValue (const std::vector<writer::Value*>& attributes): attributes(attributes) {}
+		writer::Value* get_attribute (int index) const override {
+			return attributes[index];
+		}
+		void print (File& file) const override {
+			file.print ("undef");
+		}
+	};
+	writer::Value*& value = instance_slots[slot];
+	if (value) return value;
+	// named values do not disturb the numbering of the other values
+	writer::Function* function = functions.back ();
+	if (escape_analysis->get_allocation(slot) == EscapeAnalysis::REPLACED) {
+		std::vector<writer::Value*> attributes;
+		for (ast::Variable* attribute: _class->get_attributes()) {
+			writer::Value* address = new AttributeValue (slot, attribute->get_n());
+			const writer::Type* type = writer::get_type (attribute->get_type());
+			function->insert_entry_instruction (make_instruction([=] (File& file) {
+				file.print ("% = alloca %", address, type);
+			}));
+			attributes.push_back (address);
+		}
+		value = new ReplacedInstanceValue (attributes);
+	}
+	else {
+		value = new InstanceValue (slot);
+		writer::Value* address = value;
+		const writer::Type* type = writer::get_value_type (_class);
+		function->insert_entry_instruction (make_instruction([=] (File& file) {
+			file.print ("% = alloca %", address, type);
+		}));
+	}
+	return value;
+}
+
+writer::Value* Writer::insert_allocation (const ast::Class* _class) {
+	const writer::Type* type = writer::get_value_type (_class);
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = call i8* @rea.allocate(i64 ptrtoint (%* getelementptr (%, %* null, i32 1) to i64))", address, type, type, type);
+	}));
+	writer::Value* result = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = bitcast i8* % to %*", result, address, type);
+	}));
+	functions.back()->callees.push_back ("rea.allocate");
+	return result;
+}
+
+void Writer::insert_region () {
+	writer::Value* mark = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = call i8* @rea.region.enter()", mark);
+	}));
+	functions.back()->callees.push_back ("rea.region.enter");
+	regions.push_back (mark);
+}
+
+void Writer::insert_region_release (writer::Value* mark) {
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @rea.region.leave(i8* %)", mark);
+	}));
+	functions.back()->callees.push_back ("rea.region.leave");
+}
+
+void Writer::end_region (bool reachable) {
+	if (reachable) insert_region_release (regions.back());
+	regions.pop_back ();
+}
+
+void Writer::insert_unreachable () {
+	insert_instruction (make_instruction([] (File& file) {
+		file.print ("unreachable");
+	}));
+}
+
+writer::Value* Writer::insert_array (const ast::ArrayType* _type, writer::Value* length, bool zero) {
+	const ArrayStructType type (_type);
+	writer::Value* negative = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = icmp slt i32 %, 0", negative, length);
+	}));
+	writer::Block* error = create_block ();
+	writer::Block* allocate = create_block ();
+	insert_branch (error, allocate, negative, ast::UNLIKELY);
+	insert_block (error);
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @rea.length_error(i32 %)", length);
+	}));
+	functions.back()->callees.push_back ("rea.length_error");
+	insert_unreachable ();
+	insert_block (allocate);
+	if (_type->has_columns()) return insert_columns (_type, length);
+	// the size is the offset of the element behind the last one
+	writer::Value* end = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr %, %* null, i32 0, i32 1, i32 %", end, type, type, length);
+	}));
+	writer::Value* size = next_value ();
+	const writer::Type* element_type = writer::get_type (_type->get_element_type());
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = ptrtoint %* % to i64", size, element_type, end);
+	}));
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = call i8* @rea.allocate(i64 %)", address, size);
+	}));
+	functions.back()->callees.push_back ("rea.allocate");
+	if (zero) {
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("call void @llvm.memset.p0i8.i64(i8* %, i8 0, i64 %, i1 false)", address, size);
+		}));
+		functions.back()->callees.push_back ("llvm.memset.p0i8.i64");
+	}
+	writer::Value* result = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = bitcast i8* % to %*", result, address, type);
+	}));
+	writer::Value* length_address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr %, %* %, i32 0, i32 0", length_address, type, type, result);
+	}));
+	insert_store (length_address, length, &ast::Type::INT);
+	return result;
+}
+
+// the columns follow the header in the same allocation, each of them 8 byte aligned
+writer::Value* Writer::insert_columns (const ast::ArrayType* _type, writer::Value* length) {
+	const ArrayStructType type (_type);
+	const std::vector<ast::Variable*>& attributes = _type->get_element_type()->get_class()->get_attributes ();
+	writer::Value* count = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = zext i32 % to i64", count, length);
+	}));
+	class HeaderSize: public writer::Value {
+		ArrayStructType type;
+	public:
+		HeaderSize (const ArrayStructType& type): type(type) {}
+		void print (File& file) const override {
+			file.print ("ptrtoint (%* getelementptr (%, %* null, i32 1) to i64)", type, type, type);
+		}
+	};
+	writer::Value* size = new HeaderSize (type);
+	std::vector<writer::Value*> offsets;
+	for (ast::Variable* attribute: attributes) {
+		offsets.push_back (size);
+		int element_size, alignment;
+		writer::get_layout (attribute->get_type(), element_size, alignment);
+		writer::Value* column_size = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = mul i64 %, %", column_size, count, element_size);
+		}));
+		writer::Value* padded = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = add i64 %, 7", padded, column_size);
+		}));
+		writer::Value* aligned = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = and i64 %, -8", aligned, padded);
+		}));
+		writer::Value* next = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = add i64 %, %", next, size, aligned);
+		}));
+		size = next;
+	}
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = call i8* @rea.allocate(i64 %)", address, size);
+	}));
+	functions.back()->callees.push_back ("rea.allocate");
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @llvm.memset.p0i8.i64(i8* %, i8 0, i64 %, i1 false)", address, size);
+	}));
+	functions.back()->callees.push_back ("llvm.memset.p0i8.i64");
+	writer::Value* result = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = bitcast i8* % to %*", result, address, type);
+	}));
+	writer::Value* length_address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr %, %* %, i32 0, i32 0", length_address, type, type, result);
+	}));
+	insert_store (length_address, length, &ast::Type::INT);
+	for (int i = 0; i < attributes.size(); ++i) {
+		const writer::Type* column_type = writer::get_type (attributes[i]->get_type());
+		writer::Value* offset = offsets[i];
+		writer::Value* start = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = getelementptr inbounds i8, i8* %, i64 %", start, address, offset);
+		}));
+		writer::Value* column = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = bitcast i8* % to %*", column, start, column_type);
+		}));
+		writer::Value* column_address = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = getelementptr %, %* %, i32 0, i32 %", column_address, type, type, result, i + 1);
+		}));
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("store %* %, %** %", column_type, column, column_type, column_address);
+		}));
+	}
+	return result;
+}
+
+writer::Value* Writer::insert_array_length (writer::Value* array, const ast::ArrayType* _type) {
+	const ArrayStructType type (_type);
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr %, %* %, i32 0, i32 0", address, type, type, array);
+	}));
+	return insert_load (address, &ast::Type::INT);
+}
+
+void Writer::insert_bounds_check (writer::Value* index, writer::Value* length) {
+	// the unsigned comparison also catches negative indices
+	writer::Value* inside = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = icmp ult i32 %, %", inside, index, length);
+	}));
+	writer::Block* error = create_block ();
+	writer::Block* access = create_block ();
+	insert_branch (access, error, inside, ast::LIKELY);
+	insert_block (error);
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @rea.index_error(i32 %, i32 %)", index, length);
+	}));
+	functions.back()->callees.push_back ("rea.index_error");
+	insert_unreachable ();
+	insert_block (access);
+}
+
+writer::Value* Writer::insert_element (writer::Value* array, const ast::ArrayType* _type, writer::Value* index, bool checked) {
+	const ArrayStructType type (_type);
+	if (checked) insert_bounds_check (index, insert_array_length(array, _type));
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr inbounds %, %* %, i32 0, i32 1, i32 %", address, type, type, array, index);
+	}));
+	return address;
+}
+
+writer::Value* Writer::insert_column (writer::Value* array, const ast::ArrayType* _type, writer::Value* index, int attribute, bool checked) {
+	const ArrayStructType type (_type);
+	if (checked) insert_bounds_check (index, insert_array_length(array, _type));
+	const writer::Type* column_type = writer::get_type (_type->get_element_type()->get_class()->get_attributes()[attribute]->get_type());
+	writer::Value* column_address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr %, %* %, i32 0, i32 %", column_address, type, type, array, attribute + 1);
+	}));
+	writer::Value* column = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = load %*, %** %", column, column_type, column_type, column_address);
+	}));
+	writer::Value* address = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = getelementptr inbounds %, %* %, i32 %", address, column_type, column_type, column, index);
+	}));
+	return address;
+}
+
+void Writer::insert_loop (writer::Value* count, const std::function<void (writer::Value*)>& body) {
+	// the incoming value of the back edge is only known after the body
+	struct BackEdge {
+		writer::Value* value;
+		writer::Block* block;
+	};
+	BackEdge* back_edge = new BackEdge {nullptr, nullptr};
+	writer::Block* entry = get_current_block ();
+	writer::Block* check = create_block ();
+	writer::Block* loop = create_block ();
+	writer::Block* end = create_block ();
+	insert_branch (check);
+	insert_block (check);
+	writer::Value* index = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = phi i32 [0, %], [%, %]", index, entry, back_edge->value, back_edge->block);
+	}));
+	writer::Value* condition = insert_binary_operation ("icmp slt", index, count);
+	insert_branch (loop, end, condition);
+	insert_block (loop);
+	body (index);
+	back_edge->value = insert_binary_operation ("add", index, insert_literal(1));
+	back_edge->block = get_current_block ();
+	insert_branch (check);
+	insert_block (end);
+}
+
+static writer::Value* get_undef () {
+	class UndefValue: public writer::Value {
+	public:
+		void print (File& file) const override {
+			file.print ("undef");
+		}
+	};
+	static UndefValue undef;
+	return &undef;
+}
+
+writer::Value* Writer::insert_vector (const ast::VectorType* _type, const std::vector<writer::Value*>& lanes) {
+	const writer::Type* type = writer::get_type (_type);
+	const writer::Type* element_type = writer::get_type (_type->get_element_type());
+	writer::Value* vector = get_undef ();
+	for (int i = 0; i < lanes.size(); ++i) {
+		writer::Value* lane = lanes[i];
+		writer::Value* previous = vector;
+		vector = next_value ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = insertelement % %, % %, i32 %", vector, type, previous, element_type, lane, i);
+		}));
+	}
+	if (lanes.size() == 1) {
+		// the first lane is copied into all others
+		writer::Value* first = vector;
+		vector = next_value ();
+		const int count = _type->get_lanes ();
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = shufflevector % %, % undef, <% x i32> zeroinitializer", vector, type, first, type, count);
+		}));
+	}
+	return vector;
+}
+
+writer::Value* Writer::insert_lane (writer::Value* vector, const ast::VectorType* _type, writer::Value* index, bool checked) {
+	if (checked) insert_bounds_check (index, insert_literal(_type->get_lanes()));
+	const writer::Type* type = writer::get_type (_type);
+	writer::Value* value = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = extractelement % %, i32 %", value, type, vector, index);
+	}));
+	return value;
+}
+
+writer::Value* Writer::insert_lane_address (writer::Value* address, const ast::VectorType* type, writer::Value* index, bool checked) {
+	if (checked) insert_bounds_check (index, insert_literal(type->get_lanes()));
+	return new LaneAddress (address, type, index);
+}
+
+// the name of an intrinsic for the vector type, like llvm.vector.reduce.add.v4i32
+static std::string get_intrinsic_name (const std::string& name, const ast::VectorType* type) {
+	return name + ".v" + std::to_string (type->get_lanes()) + (type->get_element_type() == &ast::Type::INT ? "i32" : "i1");
+}
+
+writer::Value* Writer::insert_reduction (const char* operation, writer::Value* vector, const ast::VectorType* _type) {
+	const std::string name = get_intrinsic_name (std::string("llvm.vector.reduce.") + operation, _type);
+	const writer::Type* type = writer::get_type (_type);
+	const writer::Type* element_type = writer::get_type (_type->get_element_type());
+	writer::Value* value = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = call % @%(% %)", value, element_type, name.c_str(), type, vector);
+	}));
+	functions.back()->callees.push_back (name);
+	return value;
+}
+
+writer::Value* Writer::insert_shuffle (writer::Value* left, writer::Value* right, const ast::VectorType* _type, const std::vector<int>& indices) {
+	const writer::Type* type = writer::get_type (_type);
+	if (!right) right = get_undef ();
+	writer::Value* value = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = shufflevector % %, % %, <% x i32> <", value, type, left, type, right, (int)indices.size());
+		for (int i = 0; i < indices.size(); ++i) {
+			if (i > 0) file.print (", ");
+			file.print ("i32 %", indices[i]);
+		}
+		file.print (">");
+	}));
+	return value;
+}
+
+writer::Value* Writer::insert_select (writer::Value* mask, writer::Value* left, writer::Value* right, const ast::Type* _type) {
+	const writer::Type* type = writer::get_type (_type);
+	const writer::Type* mask_type = writer::get_type (_type->get_vector()->get_mask());
+	writer::Value* value = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = select % %, % %, % %", value, mask_type, mask, type, left, type, right);
+	}));
+	return value;
+}
+
+// attributes with literal default values are copied from a constant template of the class,
+// which is only needed if one of them is not zero
+static bool is_constant_default (const ast::Class* _class, int index, int& value) {
+	ast::Expression* default_value = _class->get_default_values()[index];
+	return default_value && default_value->get_constant_value (value);
+}
+
+static bool has_constant_defaults (const ast::Class* _class) {
+	int value;
+	for (int i = 0; i < _class->get_attributes().size(); ++i) {
+		if (is_constant_default(_class, i, value)) return true;
+	}
+	return false;
+}
+
+static bool has_template (const ast::Class* _class) {
+	int value;
+	for (int i = 0; i < _class->get_attributes().size(); ++i) {
+		if (is_constant_default(_class, i, value) && value != 0) return true;
+	}
+	return false;
+}
+
+// the declarations of the functions the generated code calls besides the Rea functions
+static std::string get_runtime_declaration (const std::string& name) {
+	// instances that escape are allocated by the runtime in stdlib.c
+	if (name == "rea.allocate") return "declare noalias i8* @rea.allocate(i64) nounwind";
+	if (name == "rea.region.enter") return "declare i8* @rea.region.enter() nounwind";
+	if (name == "rea.region.leave") return "declare void @rea.region.leave(i8*) nounwind";
+	if (name == "rea.index_error") return "declare void @rea.index_error(i32, i32) noreturn nounwind cold";
+	if (name == "rea.length_error") return "declare void @rea.length_error(i32) noreturn nounwind cold";
+	if (name == "llvm.memset.p0i8.i64") return "declare void @llvm.memset.p0i8.i64(i8* nocapture writeonly, i8, i64, i1 immarg)";
+	if (name == "llvm.memcpy.p0i8.p0i8.i64") return "declare void @llvm.memcpy.p0i8.p0i8.i64(i8* noalias nocapture writeonly, i8* noalias nocapture readonly, i64, i1 immarg)";
+	// the reductions of vectors like llvm.vector.reduce.add.v4i32 return a lane
+	if (name.compare (0, 19, "llvm.vector.reduce.") == 0) {
+		const size_t lanes = name.rfind (".v") + 2;
+		const size_t element = name.find ('i', lanes);
+		const std::string element_type = name.substr (element);
+		return "declare " + element_type + " @" + name + "(<" + name.substr(lanes, element - lanes) + " x " + element_type + ">)";
+	}
+	return std::string ();
+}
+
+static bool has_packed_bools (const ast::Class* _class) {
+	for (const ast::Type* type: writer::get_layout(_class).fields) {
+		if (!type) return true;
+	}
+	return false;
+}
+
+bool Writer::insert_defaults (writer::Value* instance, const ast::Class* _class) {
+	// replaced instances have no memory to copy to
+	if (instance->get_attribute(0)) return false;
+	// the bytes of packed Bool attributes are cleared before their bits are stored
+	if (!has_constant_defaults(_class) && !has_packed_bools(_class)) return false;
+	const writer::Type* type = writer::get_value_type (_class);
+	if (!has_template(_class)) {
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("store % zeroinitializer, %* %", type, type, instance);
+		}));
+		return true;
+	}
+	writer::Value* destination = next_value ();
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("% = bitcast %* % to i8*", destination, type, instance);
+	}));
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @llvm.memcpy.p0i8.p0i8.i64(i8* %, i8* bitcast (%* @rea.defaults.% to i8*), i64 ptrtoint (%* getelementptr (%, %* null, i32 1) to i64), i1 false)", destination, type, _class->get_name(), type, type, type);
+	}));
+	functions.back()->callees.push_back ("llvm.memcpy.p0i8.p0i8.i64");
+	return true;
+}
+
+writer::Value* Writer::get_result_slot () {
+	class ResultValue: public writer::Value {
+	public:
+		void print (File& file) const override {
+			file.print ("%result");
+		}
+	};
+	return new ResultValue ();
+}
+
+writer::Value* Writer::insert_instance (const ast::Instantiation* instantiation, const ast::Class* _class) {
+	instances.push_back (instantiation);
+	const int instance = escape_analysis ? escape_analysis->get_instance (instances) : -1;
+	switch (escape_analysis ? escape_analysis->get_allocation (instance) : EscapeAnalysis::HEAP) {
+	case EscapeAnalysis::STACK:
+	case EscapeAnalysis::REPLACED:
+		return get_instance_slot (instance, _class);
+	case EscapeAnalysis::RESULT: {
+		// allocated by the callee if the caller passed no slot
+		writer::Value* slot = get_result_slot ();
+		writer::Value* condition = next_value ();
+		const writer::Type* type = writer::get_value_type (_class);
+		insert_instruction (make_instruction([=] (File& file) {
+			file.print ("% = icmp eq %* %, null", condition, type, slot);
+		}));
+		writer::Block* heap = create_block ();
+		writer::Block* end = create_block ();
+		writer::Block* block = get_current_block ();
+		insert_branch (heap, end, condition, ast::UNLIKELY);
+		insert_block (heap);
+		writer::Value* address = insert_allocation (_class);
+		insert_branch (end);
+		insert_block (end);
+		return insert_phi (_class, slot, block, address, heap);
+	}
+	default:
+		return insert_allocation (_class);
+	}
+}
+
+void Writer::end_instance () {
+	instances.pop_back ();
+}
+
+writer::Value* Writer::get_replaced_instance (const ast::Variable* variable, const ast::Class* _class) {
+	return get_instance_slot (escape_analysis->get_replaced_instance(variable), _class);
 }
 
 writer::Value* Writer::insert_gep (writer::Value* value, const ast::Type* type, int index) {
+	if (writer::Value* attribute = value->get_attribute(index)) return attribute;
+	class FieldValue: public writer::Value {
+		writer::Value* address;
+		int bit;
+		int alignment;
+	public:
+		FieldValue (writer::Value* address, int bit, int alignment): address(address), bit(bit), alignment(alignment) {}
+		int get_bit () const override {
+			return bit;
+		}
+		int get_alignment () const override {
+			return alignment;
+		}
+		void print (File& file) const override {
+			file.print (address);
+		}
+	};
 	class GEPInstruction: public writer::Instruction {
 		writer::Value* destination;
 		writer::Value* source;
@@ -305,11 +1429,14 @@ writer::Value* Writer::insert_gep (writer::Value* value, const ast::Type* type,
 	public:
 		GEPInstruction (writer::Value* destination, writer::Value* source, const writer::Type* type, int index): destination(destination), source(source), type(type), index(index) {}
 		void print (File& file) const override {
-			file.print ("% = getelementptr % %, i32 0, i32 %", destination, type, source, index);
+			file.print ("% = getelementptr %, %* %, i32 0, i32 %", destination, type, type, source, index);
 		}
 	};
+	const writer::Layout& layout = writer::get_layout (type->get_class());
 	writer::Value* result = next_value ();
-	insert_instruction (new GEPInstruction(result, value, writer::get_type(type), index));
+	insert_instruction (new GEPInstruction(result, value, writer::get_value_type(type->get_class()), layout.attribute_fields[index]));
+	const int bit = layout.attribute_bits[index];
+	if (bit >= 0 || layout.packed) return new FieldValue (result, bit, layout.packed ? 1 : 0);
 	return result;
 }
 
@@ -318,46 +1445,68 @@ writer::Value* Writer::insert_call (ast::Call* call, const std::vector<writer::V
 		writer::Value* value;
 		ast::Call* call;
 		std::vector<writer::Value*> arguments;
+		int slots;
 	public:
-		CallInstruction (writer::Value* value, ast::Call* call, const std::vector<writer::Value*>& arguments): value(value), call(call), arguments(arguments) {}
+		CallInstruction (writer::Value* value, ast::Call* call, const std::vector<writer::Value*>& arguments, int slots): value(value), call(call), arguments(arguments), slots(slots) {}
 		void print (File& file) const override {
 			if (value)
 				file.print ("% = call % @%(", value, writer::get_type(call->get_type()), call->get_mangled_name());
 			else
 				file.print ("call % @%(", writer::get_type(call->get_type()), call->get_mangled_name());
-			if (const ast::Type* type = call->get_argument(0)) {
-				file.print ("% %", writer::get_type(type), arguments[0]);
-				for (int i = 1; const ast::Type* type = call->get_argument(i); ++i) {
-					file.print (", % %", writer::get_type(type), arguments[i]);
-				}
+			for (int i = 0; i < arguments.size(); ++i) {
+				if (i > 0) file.print (", ");
+				file.print ("% %", writer::get_type(i < slots ? call->get_type() : call->get_argument(i - slots)), arguments[i]);
 			}
 			file.print (")");
 		}
 	};
+	std::vector<writer::Value*> values;
+	if (const ast::Class* _class = call->get_type()->get_class()) {
+		// the slot for the result
+		instances.push_back (call);
+		const int instance = escape_analysis ? escape_analysis->get_instance (instances) : -1;
+		instances.pop_back ();
+		switch (escape_analysis ? escape_analysis->get_allocation (instance) : EscapeAnalysis::HEAP) {
+		case EscapeAnalysis::STACK:
+			values.push_back (get_instance_slot (instance, _class));
+			break;
+		case EscapeAnalysis::RESULT:
+			values.push_back (get_result_slot ());
+			break;
+		default:
+			values.push_back (insert_null ());
+			break;
+		}
+	}
+	const int slots = values.size ();
+	values.insert (values.end(), arguments.begin(), arguments.end());
 	writer::Value* value = nullptr;
 	if (call->get_type() != &ast::Type::VOID)
 		value = next_value ();
-	insert_instruction (new CallInstruction(value, call, arguments));
+	insert_instruction (new CallInstruction(value, call, values, slots));
+	functions.back()->callees.push_back (writer::get_mangled_name(call));
 	return value;
 }
 
-writer::Value* Writer::insert_binary_operation (const char* operation, writer::Value* left, writer::Value* right) {
+writer::Value* Writer::insert_binary_operation (const char* operation, writer::Value* left, writer::Value* right, const ast::Type* type) {
 	class BinaryInstruction: public writer::Instruction {
 		writer::Value* value;
 		const char* operation;
 		writer::Value* left;
 		writer::Value* right;
+		const writer::Type* type;
 	public:
-		BinaryInstruction (writer::Value* value, const char* operation, writer::Value* left, writer::Value* right): value(value), operation(operation), left(left), right(right) {}
+		BinaryInstruction (writer::Value* value, const char* operation, writer::Value* left, writer::Value* right, const writer::Type* type): value(value), operation(operation), left(left), right(right), type(type) {}
 		void print (File& file) const override {
-			file.print ("% = % i32 %, %", value, operation, left, right);
+			file.print ("% = % % %, %", value, operation, type, left, right);
 		}
 	};
 	writer::Value* value = next_value ();
-	insert_instruction (new BinaryInstruction(value, operation, left, right));
+	insert_instruction (new BinaryInstruction(value, operation, left, right, writer::get_type(type)));
 	return value;
 }
 
+// the regions that are left by the return are released first
 void Writer::insert_return (writer::Value* value, const ast::Type* type) {
 	class ReturnInstruction: public writer::Instruction {
 		writer::Value* value;
@@ -369,17 +1518,23 @@ void Writer::insert_return (writer::Value* value, const ast::Type* type) {
 			else file.print ("ret void");
 		}
 	};
+	for (auto i = regions.rbegin(); i != regions.rend(); ++i) insert_region_release (*i);
 	insert_instruction (new ReturnInstruction(value, writer::get_type(type)));
 }
 void Writer::insert_return () {
+	for (auto i = regions.rbegin(); i != regions.rend(); ++i) insert_region_release (*i);
 	insert_instruction (make_instruction([] (File& file) {
 		file.print ("ret void");
 	}));
 }
 
-void Writer::insert_branch (writer::Block* true_destination, writer::Block* false_destination, writer::Value* condition) {
+// LLVM places the unlikely successor out of line based on the branch weights
+void Writer::insert_branch (writer::Block* true_destination, writer::Block* false_destination, writer::Value* condition, ast::Likelihood likelihood) {
 	insert_instruction (make_instruction([=] (File& file) {
 		file.print ("br i1 %, label %, label %", condition, true_destination, false_destination);
+		// the weights that clang uses for __builtin_expect
+		if (likelihood == ast::LIKELY) file.print (", !prof !{!\"branch_weights\", i32 2000, i32 1}");
+		else if (likelihood == ast::UNLIKELY) file.print (", !prof !{!\"branch_weights\", i32 1, i32 2000}");
 	}));
 }
 void Writer::insert_branch (writer::Block* destination) {
@@ -397,9 +1552,38 @@ writer::Value* Writer::insert_phi (const ast::Type* _type, writer::Value* value1
 	return value;
 }
 
-void Writer::insert_block (writer::Block* block) {
+void Writer::insert_counter (const char* kind, int line) {
+	if (!instrument) return;
+	writer::Function* function = functions.back ();
+	const int index = function->counters.size ();
+	function->counters.push_back (writer::Counter {kind, line});
+	// named values do not disturb the numbering of the other values
+	insert_instruction (make_instruction([=] (File& file) {
+		const int size = function->counters.size ();
+		const std::string name = writer::get_mangled_name (function->function);
+		file.print ("%%counter.% = load i64, i64* getelementptr inbounds ([% x i64], [% x i64]* @rea.counts.%, i64 0, i64 %)\n" INDENT, index, size, size, name.c_str(), index);
+		file.print ("%%counter.%.next = add i64 %%counter.%, 1\n" INDENT, index, index);
+		file.print ("store i64 %%counter.%.next, i64* getelementptr inbounds ([% x i64], [% x i64]* @rea.counts.%, i64 0, i64 %)", index, size, size, name.c_str(), index);
+	}));
+}
+
+void Writer::insert_variable_declaration (ast::Variable* variable, int argument) {
+	// hidden variables like the index of a loop over an array have no name
+	if (debug_info != writer::FULL_DEBUG_INFO || variable->get_name().get_length() == 0) return;
+	const ast::Type* type = variable->get_type ();
+	writer::Value* address = variable->value;
+	const int scope = subprogram;
+	insert_instruction (make_instruction([=] (File& file) {
+		file.print ("call void @llvm.dbg.declare(metadata %* %, metadata !DILocalVariable(name: \"%\", ", writer::get_type(type), address, variable->get_name());
+		if (argument > 0) file.print ("arg: %, ", argument);
+		file.print ("scope: !%, file: !%, line: %, type: %), metadata !DIExpression())", scope, SOURCE_FILE, variable->line, DebugType(type));
+	}));
+}
+
+void Writer::insert_block (writer::Block* block, const char* kind, int line) {
 	block->n = n++;
 	functions.back()->insert_block (block);
+	if (kind) insert_counter (kind, line);
 }
 
 void Writer::insert_function_declaration (ast::FunctionDeclaration* function_declaration) {
@@ -407,49 +1591,283 @@ void Writer::insert_function_declaration (ast::FunctionDeclaration* function_dec
 }
 
 void Writer::insert_class (ast::Class* _class) {
+	if (!_class->type) _class->type = new ClassType (_class->get_name());
+	static_cast<ClassType*>(_class->type)->metadata = FIRST_METADATA + classes.size ();
+	static_cast<ClassType*>(_class->type)->layout = create_layout (_class, optimize_layout);
 	classes.push_back (_class);
 }
 std::vector<writer::Value*> Writer::insert_function (ast::Function* function) {
 	functions.push_back (new writer::Function(function));
+	functions.back()->debug_info = debug_info;
+	functions.back()->subprogram = subprogram;
 	n = 0;
+	instance_slots.clear ();
 	std::vector<writer::Value*> result;
 	for (int i = 0; function->get_argument(i); ++i) {
 		result.push_back (next_value());
 	}
-	insert_block (new writer::Block());
+	insert_block (new writer::Block(), "function", function->line);
+	return result;
+}
+
+
+void Writer::write_declaration (File& file, ast::FunctionDeclaration* function_declaration) {
+	file.print ("declare ");
+	write_signature (file, function_declaration, false);
+	file.print ("\n\n");
+}
+
+// the indices of the functions called by each function, one entry per call
+std::vector<std::vector<int>> Writer::get_call_graph () const {
+	std::map<std::string, int> functions_by_name;
+	for (int i = 0; i < functions.size(); ++i) {
+		functions_by_name[writer::get_mangled_name(functions[i]->function)] = i;
+	}
+	std::vector<std::vector<int>> result (functions.size());
+	for (int i = 0; i < functions.size(); ++i) {
+		for (const std::string& callee: functions[i]->callees) {
+			auto j = functions_by_name.find (callee);
+			if (j != functions_by_name.end()) result[i].push_back (j->second);
+		}
+	}
 	return result;
 }
 
+// Greedily merges the most frequently connected functions into clusters of at
+// most 1/shards of the total size, then distributes the clusters evenly.
+std::vector<int> Writer::partition (int shards) const {
+	const int count = functions.size ();
+	std::vector<std::vector<int>> call_graph = get_call_graph ();
+	std::map<std::pair<int, int>, int> weights;
+	for (int i = 0; i < count; ++i) {
+		for (int j: call_graph[i]) {
+			if (i != j) weights[std::make_pair(std::min(i, j), std::max(i, j))] += 1;
+		}
+	}
+	std::vector<std::pair<int, std::pair<int, int>>> edges;
+	for (auto& weight: weights) edges.push_back (std::make_pair(-weight.second, weight.first));
+	std::sort (edges.begin(), edges.end());
+	
+	std::vector<int> parents (count);
+	std::vector<int> sizes (count);
+	int total_size = 0;
+	for (int i = 0; i < count; ++i) {
+		parents[i] = i;
+		sizes[i] = functions[i]->get_size ();
+		total_size += sizes[i];
+	}
+	auto find = [&] (int i) {
+		while (parents[i] != i) i = parents[i] = parents[parents[i]];
+		return i;
+	};
+	const int limit = total_size / shards + 1;
+	for (auto& edge: edges) {
+		int a = find (edge.second.first);
+		int b = find (edge.second.second);
+		if (a == b || sizes[a] + sizes[b] > limit) continue;
+		if (b < a) std::swap (a, b);
+		parents[b] = a;
+		sizes[a] += sizes[b];
+	}
+	
+	std::vector<std::pair<int, int>> clusters;
+	for (int i = 0; i < count; ++i) {
+		if (find(i) == i) clusters.push_back (std::make_pair(-sizes[i], i));
+	}
+	std::sort (clusters.begin(), clusters.end());
+	std::vector<int> loads (shards);
+	std::vector<int> cluster_shards (count);
+	for (auto& cluster: clusters) {
+		int shard = std::min_element(loads.begin(), loads.end()) - loads.begin();
+		loads[shard] -= cluster.first;
+		cluster_shards[cluster.second] = shard;
+	}
+	std::vector<int> result (count);
+	for (int i = 0; i < count; ++i) result[i] = cluster_shards[find(i)];
+	return result;
+}
 
-void Writer::write () {
-	File file {stdout};
+// The counters of the functions in the shard and a table of them. Every module
+// registers its own table with the standard library, which writes all of them to
+// the profile at exit, so modules that are compiled separately can be linked.
+void Writer::write_counters (File& file, const std::vector<int>& shards, int shard) {
+	std::vector<int> instrumented;
+	for (int i = 0; i < functions.size(); ++i) {
+		if (functions[i]->counters.empty() || shards[i] != shard) continue;
+		instrumented.push_back (i);
+		const std::string name = writer::get_mangled_name (functions[i]->function);
+		file.print ("@rea.counts.% = internal global [% x i64] zeroinitializer\n", name.c_str(), (int)functions[i]->counters.size());
+	}
+	if (instrumented.empty()) return;
+	file.print ("\n");
 	
-	for (ast::FunctionDeclaration* function_declaration: function_declarations) {
-		file.print ("declare % @%(", writer::get_type(function_declaration->get_return_type()), function_declaration->get_mangled_name());
-		if (const ast::Type* argument = function_declaration->get_argument(0)) {
-			file.print (writer::get_type(argument));
-			for (int i = 1; const ast::Type* argument = function_declaration->get_argument(i); ++i) {
-				file.print (", %", writer::get_type(argument));
+	file.print ("%rea.counter = type { i8*, i32 }\n");
+	file.print ("%rea.function = type { i8*, i64*, %rea.counter*, i32 }\n");
+	file.print ("%rea.instrumentation = type { %rea.function*, i32, %rea.instrumentation* }\n\n");
+	std::map<std::string, int> kinds;
+	for (int i: instrumented) {
+		for (const writer::Counter& counter: functions[i]->counters) {
+			if (kinds.count(counter.kind)) continue;
+			const int n = kinds.size ();
+			kinds[counter.kind] = n;
+			file.print ("@rea.kind.% = private constant [% x i8] c\"%\\00\"\n", n, (int)strlen(counter.kind) + 1, counter.kind);
+		}
+	}
+	for (int i: instrumented) {
+		const std::string name = writer::get_mangled_name (functions[i]->function);
+		file.print ("@rea.name.% = private constant [% x i8] c\"%\\00\"\n", i, (int)name.size() + 1, name.c_str());
+		file.print ("@rea.counters.% = private constant [% x %] [", i, (int)functions[i]->counters.size(), "%rea.counter");
+		for (int j = 0; j < functions[i]->counters.size(); ++j) {
+			const writer::Counter& counter = functions[i]->counters[j];
+			const int length = strlen (counter.kind) + 1;
+			if (j > 0) file.print (", ");
+			file.print ("%%rea.counter { i8* getelementptr inbounds ([% x i8], [% x i8]* @rea.kind.%, i64 0, i64 0), i32 % }", length, length, kinds[counter.kind], counter.line);
+		}
+		file.print ("]\n");
+	}
+	const int count = instrumented.size ();
+	file.print ("@rea.functions = private constant [% x %] [", count, "%rea.function");
+	for (int k = 0; k < count; ++k) {
+		const int i = instrumented[k];
+		const std::string name = writer::get_mangled_name (functions[i]->function);
+		const int length = name.size () + 1;
+		const int size = functions[i]->counters.size ();
+		if (k > 0) file.print (", ");
+		file.print ("%%rea.function { i8* getelementptr inbounds ([% x i8], [% x i8]* @rea.name.%, i64 0, i64 0), ", length, length, i);
+		file.print ("i64* getelementptr inbounds ([% x i64], [% x i64]* @rea.counts.%, i64 0, i64 0), ", size, size, name.c_str());
+		file.print ("%%rea.counter* getelementptr inbounds ([% x %%rea.counter], [% x %%rea.counter]* @rea.counters.%, i64 0, i64 0), i32 % }", size, size, i, size);
+	}
+	file.print ("]\n");
+	// the runtime links the tables of all modules through their last field
+	file.print ("@rea.instrumentation = internal global %%rea.instrumentation { %%rea.function* getelementptr inbounds ([% x %%rea.function], [% x %%rea.function]* @rea.functions, i64 0, i64 0), i32 %, %rea.instrumentation* null }\n\n", count, count, count);
+	file.print ("declare void @rea.register_counters(%rea.instrumentation*) nounwind\n\n");
+	file.print ("define internal void @rea.register() {\n");
+	file.print (INDENT "call void @rea.register_counters(%rea.instrumentation* @rea.instrumentation)\n");
+	file.print (INDENT "ret void\n");
+	file.print ("}\n\n");
+	file.print ("@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @rea.register, i8* null }]\n\n");
+}
+
+// the metadata that every module with debug info needs, the functions write their own
+void Writer::write_debug_info (File& file) {
+	char directory[4096];
+	if (!getcwd (directory, sizeof(directory))) directory[0] = '\0';
+	if (debug_info == writer::FULL_DEBUG_INFO) file.print ("declare void @llvm.dbg.declare(metadata, metadata, metadata)\n\n");
+	file.print ("!% = distinct !DICompileUnit(language: DW_LANG_C99, file: !%, producer: \"rea\", isOptimized: false, runtimeVersion: 0, emissionKind: %)\n", COMPILE_UNIT, SOURCE_FILE, debug_info == writer::FULL_DEBUG_INFO ? "FullDebug" : "LineTablesOnly");
+	file.print ("!% = !DIFile(filename: %, directory: %)\n", SOURCE_FILE, MetadataString(source_name.c_str()), MetadataString(directory));
+	file.print ("!% = !{i32 2, !\"Debug Info Version\", i32 3}\n", DEBUG_INFO_VERSION);
+	file.print ("!% = !{i32 7, !\"Dwarf Version\", i32 4}\n", DWARF_VERSION);
+	file.print ("!% = !DIBasicType(name: \"Int\", size: 32, encoding: DW_ATE_signed)\n", INT_TYPE);
+	file.print ("!% = !DIBasicType(name: \"Bool\", size: 8, encoding: DW_ATE_boolean)\n", BOOL_TYPE);
+	if (debug_info == writer::FULL_DEBUG_INFO) {
+		for (ast::Class* _class: classes) {
+			const int metadata = static_cast<ClassType*>(_class->type)->metadata;
+			file.print ("!% = distinct !DICompositeType(tag: DW_TAG_structure_type, name: \"%\", file: !%, elements: !{", metadata, _class->get_name(), SOURCE_FILE);
+			const writer::Layout& layout = writer::get_layout (_class);
+			for (ast::Variable* attribute: _class->get_attributes()) {
+				int attribute_size, attribute_alignment;
+				writer::get_layout (attribute->get_type(), attribute_size, attribute_alignment);
+				const int offset = layout.offsets[layout.attribute_fields[attribute->get_n()]] * 8;
+				const int bit = layout.attribute_bits[attribute->get_n()];
+				if (attribute->get_n() > 0) file.print (", ");
+				file.print ("!DIDerivedType(tag: DW_TAG_member, name: \"%\", scope: !%, file: !%, baseType: %, ", attribute->get_name(), metadata, SOURCE_FILE, DebugType(attribute->get_type()));
+				if (bit >= 0) file.print ("size: 1, offset: %, flags: DIFlagBitField, extraData: i64 %)", offset + bit, offset);
+				else file.print ("size: %, offset: %)", attribute_size * 8, offset);
 			}
+			file.print ("}, size: %)\n", layout.size * 8);
 		}
-		file.print (")\n\n");
+	}
+	file.print ("!llvm.dbg.cu = !{!%}\n", COMPILE_UNIT);
+	file.print ("!llvm.module.flags = !{!%, !%}\n", DEBUG_INFO_VERSION, DWARF_VERSION);
+}
+
+void Writer::write (FILE* output) {
+	write (output, std::vector<int>(functions.size(), 0), 0);
+}
+
+void Writer::write (FILE* output, const std::vector<int>& shards, int shard) {
+	File file {output};
+	
+	for (ast::FunctionDeclaration* function_declaration: function_declarations) {
+		write_declaration (file, function_declaration);
+	}
+	
+	// functions that are defined in other shards
+	std::vector<std::vector<int>> call_graph = get_call_graph ();
+	std::vector<bool> declared (functions.size());
+	std::vector<std::string> runtime_functions;
+	for (int i = 0; i < functions.size(); ++i) {
+		if (shards[i] != shard) continue;
+		for (int j: call_graph[i]) {
+			if (shards[j] == shard || declared[j]) continue;
+			declared[j] = true;
+			write_declaration (file, functions[j]->function);
+		}
+		for (const std::string& callee: functions[i]->callees) {
+			if (!get_runtime_declaration(callee).empty() && std::find(runtime_functions.begin(), runtime_functions.end(), callee) == runtime_functions.end()) runtime_functions.push_back (callee);
+		}
+	}
+	for (const std::string& name: runtime_functions) {
+		file.print (get_runtime_declaration(name).c_str());
+		file.print ("\n\n");
 	}
 	
 	for (ast::Class* _class: classes) {
-		file.print ("%%% = type {\n", _class->get_name());
-		auto i = _class->get_attributes().begin ();
-		if (i != _class->get_attributes().end()) {
-			file.print (INDENT "%", writer::get_type((*i)->get_type()));
-			++i;
-			while (i != _class->get_attributes().end()) {
-				file.print (",\n" INDENT "%", writer::get_type((*i)->get_type()));
-				++i;
-			}
+		const writer::Layout& layout = writer::get_layout (_class);
+		file.print ("%%% = type %{\n", _class->get_name(), layout.packed ? "<" : "");
+		for (int i = 0; i < layout.fields.size(); ++i) {
+			if (i > 0) file.print (",\n");
+			file.print (INDENT "%", FieldType(layout.fields[i]));
+		}
+		file.print ("\n}%\n\n", layout.packed ? ">" : "");
+	}
+	
+	for (ast::Class* _class: classes) {
+		if (!has_template(_class)) continue;
+		const writer::Layout& layout = writer::get_layout (_class);
+		std::vector<int> values (layout.fields.size());
+		for (int i = 0; i < _class->get_attributes().size(); ++i) {
+			int value = 0;
+			if (!is_constant_default(_class, i, value)) continue;
+			const int bit = layout.attribute_bits[i];
+			if (bit >= 0) values[layout.attribute_fields[i]] |= (value & 1) << bit;
+			else values[layout.attribute_fields[i]] = value;
+		}
+		file.print ("@rea.defaults.% = private unnamed_addr constant %%% %{", _class->get_name(), _class->get_name(), layout.packed ? "<" : "");
+		for (int i = 0; i < layout.fields.size(); ++i) {
+			const ast::Type* type = layout.fields[i];
+			if (i > 0) file.print (",");
+			if (type && (type->get_class() || type->get_array())) file.print (" % null", writer::get_type(type));
+			else if (type && type->get_vector()) file.print (" % zeroinitializer", writer::get_type(type));
+			else if (type) file.print (" % %", writer::get_type(type), values[i]);
+			else file.print (" i8 %", (int)(signed char)values[i]);
 		}
-		file.print ("\n}\n\n");
+		file.print (" }%\n\n", layout.packed ? ">" : "");
 	}
 	
-	for (writer::Function* function: functions) {
-		function->write (file);
+	if (instrument) write_counters (file, shards, shard);
+	
+	for (int i = 0; i < functions.size(); ++i) {
+		if (shards[i] == shard) functions[i]->write (file);
+	}
+	
+	if (debug_info != writer::NO_DEBUG_INFO) write_debug_info (file);
+}
+
+void Writer::write_layout_report (FILE* output) const {
+	fprintf (output, "%-24s %8s %8s %8s %8s\n", "class", "size", "align", "padding", "declared");
+	for (const ast::Class* _class: classes) {
+		const writer::Layout& layout = writer::get_layout (_class);
+		// the bytes of the fields without the padding between and after them
+		int used = 0;
+		for (const ast::Type* type: layout.fields) {
+			int size = 1, alignment = 1;
+			if (type) writer::get_layout (type, size, alignment);
+			used += size;
+		}
+		// the size in declaration order for comparison
+		const writer::Layout declared = create_layout (_class, false);
+		const std::string name (_class->get_name().get_data(), _class->get_name().get_length());
+		fprintf (output, "%-24s %8d %8d %8d %8d\n", name.c_str(), layout.size, layout.alignment, layout.size - used, declared.size);
 	}
 }
@@ -16,6 +16,8 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 */
 
 #include "ast.hpp"
+#include <functional>
+#include <string>
 
 #define INDENT "  "
 
@@ -25,10 +27,38 @@ class Type: public Printable {
 	
 };
 
+// where the attributes of an instance are stored
+struct Layout {
+	// the types of the fields, null for a byte of Bool attributes that are packed into bits
+	std::vector<const ast::Type*> fields;
+	// the offsets of the fields in bytes
+	std::vector<int> offsets;
+	// the field of every attribute and its bit, or -1 if the attribute is not packed
+	std::vector<int> attribute_fields;
+	std::vector<int> attribute_bits;
+	int size;
+	int alignment;
+	// a packed struct without padding
+	bool packed;
+};
+
 Type* get_type (const ast::Type* type);
+Type* get_value_type (const ast::Class* _class);
+// the size and alignment in bytes of an attribute
+void get_layout (const ast::Type* type, int& size, int& alignment);
+const Layout& get_layout (const ast::Class* _class);
+std::string get_mangled_name (const ast::FunctionPrototype* prototype);
 
 class Value: public Printable {
-	
+public:
+	// the attributes of an instance that was replaced by one alloca per attribute
+	virtual Value* get_attribute (int index) const { return nullptr; }
+	// the bit of a Bool attribute that shares its byte with other attributes
+	virtual int get_bit () const { return -1; }
+	// the alignment of an attribute of a packed class, 0 for the natural alignment
+	virtual int get_alignment () const { return 0; }
+	// the lane of a vector, which is stored by replacing the whole vector
+	virtual Value* get_lane () const { return nullptr; }
 };
 class RegisterValue: public Value {
 	int n;
@@ -47,20 +77,63 @@ class Block: public Printable {
 	std::vector<Instruction*> instructions;
 public:
 	int n;
+	int get_size () const {
+		return instructions.size ();
+	}
 	void insert_instruction (Instruction* instruction) {
 		instructions.push_back (instruction);
 	}
+	void insert_instruction_at_start (Instruction* instruction) {
+		instructions.insert (instructions.begin(), instruction);
+	}
 	void write (File& file);
 	void print (File& file) const override {
 		file.print ("%%%", n);
 	}
 };
 
+enum DebugInfo {
+	NO_DEBUG_INFO,
+	// only the lines of the instructions, as with -gline-tables-only
+	LINE_TABLES_ONLY,
+	// also the types of the functions and the local variables
+	FULL_DEBUG_INFO
+};
+
+// an execution counter of an instrumented build
+struct Counter {
+	const char* kind;
+	int line;
+};
+
 class Function {
 	std::vector<Block*> blocks;
+	char* text;
+	size_t length;
+	int size;
 public:
 	ast::Function* function;
-	Function (ast::Function* function): function(function) {}
+	// the mangled names of the called functions
+	std::vector<std::string> callees;
+	std::vector<Counter> counters;
+	DebugInfo debug_info;
+	// the number of the DISubprogram metadata
+	int subprogram;
+	Function (ast::Function* function): text(nullptr), length(0), size(0), function(function), debug_info(NO_DEBUG_INFO), subprogram(0) {}
+	// a function that was already rendered, for example by an earlier compilation
+	Function (ast::Function* function, char* text, size_t length, int size, const std::vector<std::string>& callees): text(text), length(length), size(size), function(function), callees(callees), debug_info(NO_DEBUG_INFO), subprogram(0) {}
+	int get_size () const {
+		if (text) return size;
+		int size = 0;
+		for (Block* block: blocks) size += block->get_size ();
+		return size;
+	}
+	const char* get_text () const {
+		return text;
+	}
+	size_t get_length () const {
+		return length;
+	}
 	Block* get_current_block () const {
 		return blocks.back ();
 	}
@@ -70,6 +143,11 @@ public:
 	void insert_instruction (Instruction* instruction) {
 		blocks.back()->insert_instruction (instruction);
 	}
+	// allocas in the entry block are only executed once
+	void insert_entry_instruction (Instruction* instruction) {
+		blocks.front()->insert_instruction_at_start (instruction);
+	}
+	void render ();
 	void write (File& file);
 };
 
@@ -80,27 +158,104 @@ class Writer {
 	std::vector<ast::Class*> classes;
 	std::vector<writer::Function*> functions;
 	int n;
+	bool instrument;
+	bool optimize_layout;
+	writer::DebugInfo debug_info;
+	std::string source_name;
+	int subprogram;
+	// the source line of the instructions that are inserted
+	int line;
+	const EscapeAnalysis* escape_analysis;
+	// the instantiations that are being inserted
+	std::vector<const ast::Expression*> instances;
+	std::map<int, writer::Value*> instance_slots;
+	writer::Instruction* add_location (writer::Instruction* instruction);
 	void insert_instruction (writer::Instruction* instruction) {
+		profile::count_instruction ();
+		if (debug_info != writer::NO_DEBUG_INFO) instruction = add_location (instruction);
 		functions.back()->insert_instruction (instruction);
 	}
+	static void write_declaration (File& file, ast::FunctionDeclaration* function_declaration);
+	void write_counters (File& file, const std::vector<int>& shards, int shard);
+	void write_debug_info (File& file);
+	std::vector<std::vector<int>> get_call_graph () const;
+	writer::Value* get_instance_slot (int slot, const ast::Class* _class);
+	// the marks of the regions that are being inserted
+	std::vector<writer::Value*> regions;
+	writer::Value* insert_allocation (const ast::Class* _class);
+	void insert_region_release (writer::Value* mark);
+	void insert_unreachable ();
+	writer::Value* insert_columns (const ast::ArrayType* type, writer::Value* length);
+	void insert_bounds_check (writer::Value* index, writer::Value* length);
+	// the slot for the result that the caller passes to functions that return instances
+	writer::Value* get_result_slot ();
 	writer::Value* next_value (const ast::Type* type = &ast::Type::VOID) {
 		return new writer::RegisterValue (n++);
 	}
 public:
+	// instrumented functions count how often their blocks are executed
+	Writer (bool instrument = false): n(0), instrument(instrument), optimize_layout(false), debug_info(writer::NO_DEBUG_INFO), subprogram(0), line(0), escape_analysis(nullptr) {}
+	// a writer for the function with the given index that uses the options of the parent
+	Writer (const Writer& parent, int index);
+	bool is_instrumented () const {
+		return instrument;
+	}
+	void set_debug_info (writer::DebugInfo debug_info, const char* source_name) {
+		this->debug_info = debug_info;
+		this->source_name = source_name;
+	}
+	// sort the attributes by alignment and pack Bool attributes into bits
+	void set_optimize_layout (bool optimize_layout) {
+		this->optimize_layout = optimize_layout;
+	}
+	void set_line (int line) {
+		this->line = line;
+	}
+	void set_escape_analysis (const EscapeAnalysis* escape_analysis) {
+		this->escape_analysis = escape_analysis;
+	}
 	writer::Value* insert_literal (int n);
+	writer::Value* insert_null ();
 	writer::Value* insert_load (writer::Value* value, const ast::Type* type);
 	void insert_store (writer::Value* destination, writer::Value* source, const ast::Type* type);
 	writer::Value* insert_alloca (const writer::Type* type);
 	writer::Value* insert_alloca (const ast::Type* type);
-	writer::Value* insert_alloca_value (const ast::Class* _class);
+	// allocates an instance in its stack slot or on the heap, see EscapeAnalysis
+	writer::Value* insert_instance (const ast::Instantiation* instantiation, const ast::Class* _class);
+	void end_instance ();
+	// initializes the attributes with constant default values, returns false if it did not
+	bool insert_defaults (writer::Value* instance, const ast::Class* _class);
+	writer::Value* get_replaced_instance (const ast::Variable* variable, const ast::Class* _class);
+	// the heap instances that are allocated between the two calls are freed at the end of the region
+	void insert_region ();
+	void end_region (bool reachable);
 	writer::Value* insert_gep (writer::Value* value, const ast::Type* type, int index);
+	// arrays are allocated like heap instances, their elements are zeroed if zero is true
+	writer::Value* insert_array (const ast::ArrayType* type, writer::Value* length, bool zero);
+	writer::Value* insert_array_length (writer::Value* array, const ast::ArrayType* type);
+	// the address of an element, which is only checked against the length if checked is true
+	writer::Value* insert_element (writer::Value* array, const ast::ArrayType* type, writer::Value* index, bool checked);
+	// the address of an attribute of an element of an array of a soa class
+	writer::Value* insert_column (writer::Value* array, const ast::ArrayType* type, writer::Value* index, int attribute, bool checked);
+	// inserts the body once for every index from 0 to count
+	void insert_loop (writer::Value* count, const std::function<void (writer::Value*)>& body);
+	// a vector of the given lanes, a single lane is copied into all lanes
+	writer::Value* insert_vector (const ast::VectorType* type, const std::vector<writer::Value*>& lanes);
+	writer::Value* insert_lane (writer::Value* vector, const ast::VectorType* type, writer::Value* index, bool checked);
+	writer::Value* insert_lane_address (writer::Value* address, const ast::VectorType* type, writer::Value* index, bool checked);
+	writer::Value* insert_reduction (const char* operation, writer::Value* vector, const ast::VectorType* type);
+	// the right vector is undefined if it is null
+	writer::Value* insert_shuffle (writer::Value* left, writer::Value* right, const ast::VectorType* type, const std::vector<int>& indices);
+	writer::Value* insert_select (writer::Value* mask, writer::Value* left, writer::Value* right, const ast::Type* type);
 	writer::Value* insert_call (ast::Call* call, const std::vector<writer::Value*>& arguments);
-	writer::Value* insert_binary_operation (const char* operation, writer::Value* left, writer::Value* right);
+	writer::Value* insert_binary_operation (const char* operation, writer::Value* left, writer::Value* right, const ast::Type* type = &ast::Type::INT);
 	void insert_return (writer::Value* value, const ast::Type* type);
 	void insert_return ();
 	void insert_branch (writer::Block* destination);
-	void insert_branch (writer::Block* true_destination, writer::Block* false_destination, writer::Value* condition);
+	void insert_branch (writer::Block* true_destination, writer::Block* false_destination, writer::Value* condition, ast::Likelihood likelihood = ast::UNKNOWN);
 	writer::Value* insert_phi (const ast::Type* type, writer::Value* value1, writer::Block* block1, writer::Value* value2, writer::Block* block2);
+	void insert_counter (const char* kind, int line);
+	void insert_variable_declaration (ast::Variable* variable, int argument);
 	
 	writer::Block* get_current_block () {
 		return functions.back()->get_current_block ();
@@ -108,10 +263,20 @@ public:
 	writer::Block* create_block () {
 		return new writer::Block ();
 	}
-	void insert_block (writer::Block* block);
+	void insert_block (writer::Block* block, const char* kind = nullptr, int line = 0);
 	void insert_function_declaration (ast::FunctionDeclaration* function_declaration);
 	void insert_class (ast::Class* _class);
 	std::vector<writer::Value*> insert_function (ast::Function* function);
+	writer::Function* get_function () const {
+		return functions.back ();
+	}
+	void append_function (writer::Function* function) {
+		functions.push_back (function);
+	}
 	
-	void write ();
+	std::vector<int> partition (int shards) const;
+	void write (FILE* output = stdout);
+	void write (FILE* output, const std::vector<int>& shards, int shard);
+	// the size and the padding of every class
+	void write_layout_report (FILE* output) const;
 };